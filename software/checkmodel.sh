@@ -0,0 +1,45 @@
+#!/usr/bin/env bash
+set -uo pipefail
+
+# Checks an unpacked Edge Impulse Arduino library for what makes the classifier fast on the ESP32:
+# an int8 quantized model and the ESP-NN kernels. Warns if the model would fall back to the reference kernels.
+#   checkmodel.sh [<library dir>]      (default ./uC/lib/ei_arduino_library, where unpacklibraries.sh puts it)
+
+LIB_DIR="${1:-./uC/lib/ei_arduino_library}"
+METADATA="$LIB_DIR/model-parameters/model_metadata.h"
+VARIABLES="$LIB_DIR/model-parameters/model_variables.h"
+warnings=0
+
+if [[ ! -f "$METADATA" ]]; then
+  echo "Error: no model found in '$LIB_DIR'."
+  exit 2
+fi
+
+version=$(sed -n 's/^#define EI_CLASSIFIER_PROJECT_DEPLOY_VERSION *\([0-9]*\).*/\1/p' "$METADATA")
+arena=$(sed -n 's/^#define EI_CLASSIFIER_TFLITE_LARGEST_ARENA_SIZE *\([0-9]*\).*/\1/p' "$METADATA")
+echo "model deploy version ${version:-?}, largest tensor arena ${arena:-?} bytes"
+
+# int8: ESP-NN only accelerates quantized models. Every model defines EI_CLASSIFIER_DATATYPE_INT8,
+# the input datatype of the network tells (as in inference.cpp), by name or by value
+define_value() {
+  sed -n "s/^#define $1 *\([A-Za-z0-9_]*\).*/\1/p" "$METADATA" "$VARIABLES" 2>/dev/null | head -n 1
+}
+input_type=$(define_value EI_CLASSIFIER_TFLITE_INPUT_DATATYPE)
+int8_type=$(define_value EI_CLASSIFIER_DATATYPE_INT8)
+if [[ -n "$input_type" && ( "$input_type" == "EI_CLASSIFIER_DATATYPE_INT8" || "$input_type" == "$int8_type" ) ]]; then
+  echo "model is int8 quantized"
+else
+  echo "WARNING: model is not int8 quantized, it runs on the slow float reference kernels."
+  echo "         Deploy the 'Quantized (int8)' variant in Edge Impulse."
+  warnings=1
+fi
+
+# ESP-NN sources have to be part of the library
+if find "$LIB_DIR" -type d -name "ESP-NN" | grep -q .; then
+  echo "ESP-NN kernels present"
+else
+  echo "WARNING: the library ships without ESP-NN, the classifier falls back to the reference kernels."
+  warnings=1
+fi
+
+exit $warnings
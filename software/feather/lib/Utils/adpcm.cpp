@@ -0,0 +1,67 @@
+#include "adpcm.h"
+
+static const int16_t stepTable[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+  337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t indexTable[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+void AdpcmEncoder::reset() {
+  predictor = 0;
+  index = 0;
+}
+
+// one sample, the reconstruction is done exactly as in the decoder so both stay in sync
+static inline uint8_t encodeSample(int32_t sample, int32_t &predictor, int32_t &index) {
+  int32_t step = stepTable[index];
+  int32_t diff = sample - predictor;
+  uint8_t nibble = 0;
+  if (diff < 0) {
+    nibble = 8;
+    diff = -diff;
+  }
+
+  int32_t delta = step >> 3;
+  if (diff >= step) { nibble |= 4; diff -= step; delta += step; }
+  step >>= 1;
+  if (diff >= step) { nibble |= 2; diff -= step; delta += step; }
+  step >>= 1;
+  if (diff >= step) { nibble |= 1; delta += step; }
+
+  predictor += (nibble & 8) ? -delta : delta;
+  if (predictor > 32767) predictor = 32767;
+  if (predictor < -32768) predictor = -32768;
+
+  index += indexTable[nibble & 7];
+  if (index < 0) index = 0;
+  if (index > 88) index = 88;
+  return nibble;
+}
+
+size_t AdpcmEncoder::encodeBlock(const int16_t* in, size_t samples, uint8_t* out) {
+  out[0] = (uint8_t)(predictor & 0xFF);
+  out[1] = (uint8_t)((predictor >> 8) & 0xFF);
+  out[2] = (uint8_t)index;
+  out[3] = 0;
+  uint8_t* dst = out + ADPCM_HEADER_BYTES;
+
+  // state in locals, the compiler keeps them in registers
+  int32_t p = predictor;
+  int32_t idx = index;
+  size_t i = 0;
+  for (; i + 1 < samples; i += 2) {
+    uint8_t lo = encodeSample(in[i], p, idx);
+    uint8_t hi = encodeSample(in[i+1], p, idx);
+    *dst++ = lo | (hi << 4);
+  }
+  if (i < samples)
+    *dst++ = encodeSample(in[i], p, idx);
+
+  predictor = p;
+  index = idx;
+  return dst - out;
+}
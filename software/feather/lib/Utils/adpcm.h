@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// IMA-ADPCM encoder, 4 bits per sample (4:1 against PCM16).
+// Audio is encoded in independent blocks: a 4 byte header carrying the encoder state
+// (predictor int16, step index, reserved) followed by two samples per byte, low nibble first.
+// The state runs on from block to block, the header only lets the decoder start at any block.
+
+enum AudioCodec { CODEC_PCM16 = 0, CODEC_ADPCM = 1 };
+
+#define ADPCM_HEADER_BYTES 4
+#define ADPCM_BLOCK_SAMPLES 1024                          // block size of HTTP uploads
+#define ADPCM_BLOCK_BYTES(samples) (ADPCM_HEADER_BYTES + ((samples) + 1) / 2)
+
+class AdpcmEncoder {
+  public:
+    AdpcmEncoder() { reset(); };
+    void reset();
+
+    // encodes samples into out (ADPCM_BLOCK_BYTES(samples) bytes), returns the number of bytes written.
+    // An odd number of samples is padded with one sample.
+    size_t encodeBlock(const int16_t* in, size_t samples, uint8_t* out);
+
+  private:
+    int32_t predictor;
+    int32_t index;
+};
@@ -0,0 +1,130 @@
+#include <Arduino.h>
+#include "agc.h"
+#include "constants.h"
+
+AgcConfig agcConfig;
+
+void AutoGain::init(float rate) {
+  sampleRate = rate;
+  band.clear();
+  band.addSection(BIQUAD_HIGHPASS, 300.0f, rate);
+  band.addSection(BIQUAD_LOWPASS, 3400.0f, rate);
+  coefLen = 0;
+  reset();
+}
+
+void AutoGain::reset() {
+  gain = AGC_UNITY;
+  envelope = 0;
+  band.reset();
+}
+
+// per block: 1 - exp(-len / tau), recomputed only when the block length or the times change
+void AutoGain::updateCoefficients(size_t len) {
+  if ((len == coefLen) && (coefAttackMs == agcConfig.attackMs) && (coefReleaseMs == agcConfig.releaseMs))
+    return;
+  coefLen = len;
+  coefAttackMs = agcConfig.attackMs;
+  coefReleaseMs = agcConfig.releaseMs;
+  float attackSamples = (coefAttackMs > 0) ? coefAttackMs * sampleRate / 1000.0f : 1.0f;
+  float releaseSamples = (coefReleaseMs > 0) ? coefReleaseMs * sampleRate / 1000.0f : 1.0f;
+  attackCoef = (int32_t)((1.0f - expf(-(float)len / attackSamples)) * (1 << AGC_COEF_Q));
+  releaseCoef = (int32_t)((1.0f - expf(-(float)len / releaseSamples)) * (1 << AGC_COEF_Q));
+}
+
+int32_t AutoGain::targetGain() const {
+  if (envelope < agcConfig.gateLevel)
+    return AGC_UNITY;
+  int32_t g = ((int32_t)agcConfig.targetLevel << AGC_GAIN_Q) / envelope;
+  if (g > agcConfig.maxGain)
+    g = agcConfig.maxGain;
+  if (g < agcConfig.minGain)
+    g = agcConfig.minGain;
+  return g;
+}
+
+void AutoGain::processBlock(int16_t* buffer, size_t len) {
+  if (len == 0)
+    return;
+  updateCoefficients(len);
+  int32_t target = targetGain();
+  if (envelope < agcConfig.gateLevel)
+    gatedBlocks++;
+
+  // gain ramp with 8 more fractional bits
+  int32_t g = gain * 256;
+  int32_t step = (target - gain) * 256 / (int32_t)len;
+
+  // detector state in locals for the whole block
+  const uint8_t sections = band.sections;
+  int32_t sx1[BIQUAD_MAX_SECTIONS], sx2[BIQUAD_MAX_SECTIONS], sy1[BIQUAD_MAX_SECTIONS], sy2[BIQUAD_MAX_SECTIONS];
+  for (uint8_t s = 0;s<sections;s++) {
+    sx1[s] = band.x1[s]; sx2[s] = band.x2[s];
+    sy1[s] = band.y1[s]; sy2[s] = band.y2[s];
+  }
+
+  uint32_t levelSum = 0;
+  uint32_t clipped = 0;
+  for (size_t i = 0;i<len;i++) {
+    const int32_t x0 = buffer[i];
+
+    // speech band of the input, for the level only
+    int32_t v = x0;
+    for (uint8_t s = 0;s<sections;s++) {
+      int64_t acc = (int64_t)band.b0[s] * v + (int64_t)band.b1[s] * sx1[s] + (int64_t)band.b2[s] * sx2[s]
+                  - (int64_t)band.a1[s] * sy1[s] - (int64_t)band.a2[s] * sy2[s];
+      int32_t y = (int32_t)(acc >> BIQUAD_Q);
+      if (y >  32767) y =  32767;
+      if (y < -32768) y = -32768;
+      sx2[s] = sx1[s]; sx1[s] = v;
+      sy2[s] = sy1[s]; sy1[s] = y;
+      v = y;
+    }
+    levelSum += (v < 0) ? -v : v;
+
+    // the input itself gets the gain
+    int32_t out = (x0 * (g >> 8)) >> AGC_GAIN_Q;
+    if ((out > 32767) || (out < -32768)) {
+      // limiter: the largest gain that keeps this sample in range, no increase for the rest of the block
+      int32_t magnitude = (x0 < 0) ? -x0 : x0;
+      g = ((32767 << AGC_GAIN_Q) / magnitude) * 256;
+      if (step > 0)
+        step = 0;
+      out = (x0 * (g >> 8)) >> AGC_GAIN_Q;
+      clipped++;
+    }
+    buffer[i] = (int16_t)out;
+    g += step;
+  }
+
+  for (uint8_t s = 0;s<sections;s++) {
+    band.x1[s] = sx1[s]; band.x2[s] = sx2[s];
+    band.y1[s] = sy1[s]; band.y2[s] = sy2[s];
+  }
+
+  // envelope with attack and release
+  int32_t level = levelSum / len;
+  int32_t coef = (level > envelope) ? attackCoef : releaseCoef;
+  envelope += ((level - envelope) * coef) >> AGC_COEF_Q;
+
+  // a limited block ends below the target, the ramp continues from there
+  gain = (clipped > 0) ? (g - step) / 256 : target;
+  clippedSamples += clipped;
+  blocks++;
+}
+
+void AutoGain::apply(int16_t* buffer, size_t len) {
+  for (size_t i = 0;i<len;i++) {
+    int32_t out = (buffer[i] * gain) >> AGC_GAIN_Q;
+    if (out >  32767) out =  32767;
+    if (out < -32768) out = -32768;
+    buffer[i] = (int16_t)out;
+  }
+}
+
+void printAgcStats(const AutoGain& agc) {
+  println("AGC %s: gain %.2f (%.1f dB), level %d, target %u, gate %u",
+          agcConfig.enabled ? "on" : "off", (float)agc.gain / AGC_UNITY, 20.0f * log10f((float)agc.gain / AGC_UNITY),
+          agc.envelope, agcConfig.targetLevel, agcConfig.gateLevel);
+  println("   %u blocks, %u below the gate, %u samples clipped", agc.blocks, agc.gatedBlocks, agc.clippedSamples);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Arduino.h>
+#include "biquad.h"
+
+// Block-based automatic gain control in fixed point, in front of the classifier. The silence gate and
+// stage 1 of the cascade measure the slice before the gain, so amplified noise never opens them.
+// The level is the mean absolute value of the input within the speech band (300-3400 Hz), so a piano
+// or hum below it does not pull the gain down. The band filter only feeds the detector: it runs in the
+// same pass over the block that applies the gain, the classifier keeps seeing the full band.
+// The gain for a block is derived from the envelope up to the previous block and ramps linearly across
+// the block, the envelope follows the level with separate attack and release times. A sample the gain
+// would drive beyond full scale cuts the gain right there and for the rest of the block (limiter), so
+// a loud onset within the block is bounded by its own level, not only by the previous blocks.
+// Below gateLevel nothing is amplified (noise gate), the gain returns to unity.
+
+#define AGC_GAIN_Q 12                           // gain in Q12
+#define AGC_UNITY (1 << AGC_GAIN_Q)
+#define AGC_COEF_Q 15                           // envelope coefficients in Q15
+
+struct AgcConfig {
+  bool enabled = true;
+  uint16_t targetLevel = 2600;                  // speech-band level after the gain, about -21 dBFS RMS
+  uint16_t gateLevel = 300;                     // speech-band level below which nothing is amplified, about -40 dBFS
+  uint16_t maxGain = 8 * AGC_UNITY;             // [Q12] +18 dB
+  uint16_t minGain = AGC_UNITY / 4;             // [Q12] -12 dB
+  uint16_t attackMs = 10;
+  uint16_t releaseMs = 1000;
+};
+extern AgcConfig agcConfig;
+
+struct AutoGain {
+  BiquadCascade band;                           // speech band of the detector
+
+  int32_t gain = AGC_UNITY;                     // [Q12] reached at the end of the last block
+  int32_t envelope = 0;                         // smoothed speech-band level of the input
+
+  // counters since boot, the heartbeat sends them
+  uint32_t blocks = 0;
+  uint32_t gatedBlocks = 0;                     // blocks that started below the gate
+  uint32_t clippedSamples = 0;                  // samples the gain would have driven beyond full scale (limited)
+
+  // set up the detector for sampleRate [Hz] and reset
+  void init(float sampleRate);
+
+  // unity gain, zero envelope and detector state, the counters keep running
+  void reset();
+
+  // level len samples in place, one pass for detector and gain
+  void processBlock(int16_t* buffer, size_t len);
+
+  // scale len samples by the current gain, the state stays as it is (slices replayed out of order)
+  void apply(int16_t* buffer, size_t len);
+
+  // gain the next block ramps to
+  int32_t targetGain() const;
+
+  private:
+    size_t coefLen = 0;                         // block length the coefficients belong to
+    uint16_t coefAttackMs = 0, coefReleaseMs = 0;
+    int32_t attackCoef = 0, releaseCoef = 0;    // [Q15] per block
+    float sampleRate = 0;
+    void updateCoefficients(size_t len);
+};
+
+void printAgcStats(const AutoGain& agc);
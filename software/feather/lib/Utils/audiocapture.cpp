@@ -0,0 +1,158 @@
+#include <Arduino.h>
+#include <driver/i2s.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+#include "soundtools.h"
+#include "constants.h"
+#include "recording.h"
+#include "flightrecorder.h"
+#if MIC_SAMPLE_RATE != SAMPLE_RATE
+#include "resampler.h"
+#endif
+
+AudioCaptureStats captureStats;
+
+static QueueHandle_t i2sEventQueue = NULL;
+static TaskHandle_t captureTaskHandle = NULL;
+static uint32_t lastDrainedPos = 0;                     // ring position the main loop has consumed so far
+
+#if MIC_SAMPLE_RATE != SAMPLE_RATE
+static PolyphaseResampler micResampler;
+static int16_t micBlock[I2S_DMA_BUF_LEN];
+static int16_t resampledBlock[I2S_DMA_BUF_LEN * SAMPLE_RATE / MIC_SAMPLE_RATE + 2];
+#endif
+
+// Capture task: blocks in i2s_read until the DMA has a buffer ready and writes it straight into the ring
+// (at a different microphone rate it is resampled on the way). Runs pinned on its own core, so
+// inference, BLE and networking can never stall it.
+static void audioCaptureTask(void* param) {
+  uint32_t windowStart_us = micros();
+  uint32_t windowBusy_us = 0;
+
+  for (;;) {
+    size_t bytes = 0;
+#if MIC_SAMPLE_RATE == SAMPLE_RATE
+    size_t len;
+    int16_t* dst = audioRing.writePtr(I2S_DMA_BUF_LEN, len);
+    i2s_read(I2S_PORT, dst, len * sizeof(int16_t), &bytes, portMAX_DELAY);
+    uint32_t busyStart_us = micros();
+
+    size_t samples = bytes / sizeof(int16_t);
+    audioRing.commit(samples);
+#else
+    i2s_read(I2S_PORT, micBlock, sizeof(micBlock), &bytes, portMAX_DELAY);
+    uint32_t busyStart_us = micros();
+
+    int16_t* dst = resampledBlock;
+    size_t samples = micResampler.process(micBlock, bytes / sizeof(int16_t), dst);
+    audioRing.write(dst, samples);
+#endif
+    captureStats.capturedSamples += samples;
+    recordAudio(dst, samples);
+    flightRecordAudio(dst, samples);
+
+    // DMA overflow means the task was not scheduled in time and a DMA buffer got lost
+    i2s_event_t event;
+    while (xQueueReceive(i2sEventQueue, &event, 0) == pdTRUE) {
+      if (event.type == I2S_EVENT_RX_Q_OVF) 
+        captureStats.droppedSamples += I2S_DMA_BUF_LEN * SAMPLE_RATE / MIC_SAMPLE_RATE;
+    }
+
+    // cpu load of this task, measured over windows of 1s
+    uint32_t now = micros();
+    windowBusy_us += now - busyStart_us;
+    if (now - windowStart_us > 1000000) {
+      captureStats.cpuLoad = (float)windowBusy_us / (float)(now - windowStart_us);
+      captureStats.stackHighWater = uxTaskGetStackHighWaterMark(NULL);
+      windowStart_us = now;
+      windowBusy_us = 0;
+    }
+  }
+}
+
+void initAudio() {
+  // Initialize I2S in Philips mode, 16kHz, 16-bit, received via DMA
+  i2s_config_t i2s_config = {
+    .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
+    .sample_rate = MIC_SAMPLE_RATE,
+    .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+    .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
+    .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+    .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+    .dma_buf_count = I2S_DMA_BUF_COUNT,
+    .dma_buf_len = I2S_DMA_BUF_LEN,
+    .use_apll = false,
+    .tx_desc_auto_clear = false,
+    .fixed_mclk = 0
+  };
+  i2s_pin_config_t pin_config = {
+    .bck_io_num = I2S_SCK_PIN,
+    .ws_io_num = I2S_WS_PIN,
+    .data_out_num = I2S_PIN_NO_CHANGE,
+    .data_in_num = I2S_SD_PIN
+  };
+
+  if ((i2s_driver_install(I2S_PORT, &i2s_config, 8, &i2sEventQueue) != ESP_OK) ||
+      (i2s_set_pin(I2S_PORT, &pin_config) != ESP_OK)) {
+    Serial.println("Failed to initialize I2S!");
+    while(1); // Halt on failure
+  }
+  Serial.println("I2S initialized successfully");
+
+  // initialise speech bandpass filter (300–3400 Hz)
+  initSpeechFilter();
+
+#if MIC_SAMPLE_RATE != SAMPLE_RATE
+  if (!micResampler.init(MIC_SAMPLE_RATE, SAMPLE_RATE)) {
+    Serial.println("Microphone rate not supported by the resampler!");
+    while(1); // Halt on failure
+  }
+  println("microphone at %u Hz, resampled to %u Hz (%u taps per phase)", MIC_SAMPLE_RATE, SAMPLE_RATE, micResampler.taps);
+#endif
+
+  // start capturing on the core that is not running loop()
+  xTaskCreatePinnedToCore(audioCaptureTask, "audioCapture", AUDIO_CAPTURE_STACK_SIZE, NULL,
+                          AUDIO_CAPTURE_PRIORITY, &captureTaskHandle, AUDIO_CAPTURE_CORE);
+}
+
+/**
+ * Checks if audio data is available
+ * @return true if the capture task has written samples that have not been drained yet
+ */
+bool isAudioAvailable() {
+  return audioRing.written() != lastDrainedPos;
+}
+
+// Take over everything the capture task has written into the audio ring since the last call
+void drainAudioData(size_t &added_samples) {
+  uint32_t head = audioRing.written();
+  added_samples = head - lastDrainedPos;
+  lastDrainedPos = head;
+
+  // samples waiting for the main loop, if it exceeds the ring the consumer lost audio
+  if (added_samples > captureStats.maxPendingSamples)
+    captureStats.maxPendingSamples = added_samples;
+  if (added_samples > AUDIO_RING_SIZE)
+    captureStats.overrunSamples += added_samples - AUDIO_RING_SIZE;
+}
+
+void printAudioCaptureStats() {
+  println("audio capture on core %i: %u samples, %u dropped by DMA, %u overrun in ring",
+          AUDIO_CAPTURE_CORE, captureStats.capturedSamples, captureStats.droppedSamples, captureStats.overrunSamples);
+  println("   capture task load %.1f%%, stack high water %u B, max pending %u samples",
+          captureStats.cpuLoad*100.0, captureStats.stackHighWater, captureStats.maxPendingSamples);
+
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+  // per task load as counted by FreeRTOS
+  static TaskStatus_t tasks[24];
+  uint32_t totalRunTime;
+  UBaseType_t count = uxTaskGetSystemState(tasks, sizeof(tasks)/sizeof(tasks[0]), &totalRunTime);
+  for (UBaseType_t i = 0;i<count;i++) {
+    if (totalRunTime > 0)
+      println("   %-16s load %5.1f%% stack %u",tasks[i].pcTaskName,
+              100.0 * tasks[i].ulRunTimeCounter / totalRunTime, tasks[i].usStackHighWaterMark);
+  }
+#endif
+}
@@ -14,7 +14,6 @@ bool batMonitorInitialised = false;
 // MAX17048 i2c address
 bool addr0x36 = true;
 
-uint32_t lastReadTime = millis();
 float lastCcellVoltage;
 float lastCellPercentage;
 
@@ -70,7 +69,15 @@ void initBatteryMonitor() {
   
 }
 
-// after 3 seconds of the pushing the button tiny turner turns off
+static bool tapped = false;
+
+bool powerButtonTapped() {
+  bool t = tapped;
+  tapped = false;
+  return t;
+}
+
+// after 3 seconds of the pushing the button tiny turner turns off, a short press is a tap
 void loopPowerButton() {
   static uint32_t pushedSince = 0; 
   if (digitalRead(POWER_BUTTON_PIN) == LOW) {
@@ -85,35 +92,37 @@ void loopPowerButton() {
       }
     }
   } else {
+    if ((pushedSince != 0) && (millis() - pushedSince < 1000))
+      tapped = true;
     pushedSince = 0;
   }
 }
 
 void readBatMonitor(float &cellVoltage, float &cellPercentage) {
 #ifdef BOARD_IS_FEATHER_S3
-    if (millis() - lastReadTime > 5000) {
-       if (addr0x36 == true) {
-                lastCcellVoltage = maxlipo.cellVoltage();
-                lastCellPercentage = maxlipo.cellPercent();
-        }
-        else {
-                lastCcellVoltage = lc.cellVoltage();
-                lastCellPercentage = lc.cellPercent();
-        }
-        lastReadTime = millis();
+    if (addr0x36 == true) {
+            lastCcellVoltage = maxlipo.cellVoltage();
+            lastCellPercentage = maxlipo.cellPercent();
+    }
+    else {
+            lastCcellVoltage = lc.cellVoltage();
+            lastCellPercentage = lc.cellPercent();
     }
     cellVoltage = lastCcellVoltage;
     cellPercentage = lastCellPercentage;
 #endif
 #ifdef BOARD_IS_FEATHER_V2
-  if (millis() - lastReadTime > 5000) {
-    float  measuredvbat = analogReadMilliVolts(VBAT_PIN);
-    measuredvbat *= 2;    // we divided by 2, so multiply back
-    measuredvbat /= 1000; // convert to volts!
-    lastReadTime = millis();
-    lastCcellVoltage = measuredvbat;
-  }
+  float  measuredvbat = analogReadMilliVolts(VBAT_PIN);
+  measuredvbat *= 2;    // we divided by 2, so multiply back
+  measuredvbat /= 1000; // convert to volts!
+  lastCcellVoltage = measuredvbat;
+  lastCellPercentage = lastCcellVoltage/4.2*100.0;
   cellVoltage = lastCcellVoltage;
-  cellPercentage = lastCcellVoltage/4.2*100.0;
+  cellPercentage = lastCellPercentage;
 #endif
 }
+
+void lastBatReading(float &cellVoltage, float &cellPercentage) {
+  cellVoltage = lastCcellVoltage;
+  cellPercentage = lastCellPercentage;
+}
@@ -1,5 +1,7 @@
 #pragma once
 
 void initBatteryMonitor();
-void readBatMonitor(float &cellVoltage, float &cellPercentage);
+void readBatMonitor(float &cellVoltage, float &cellPercentage);      // reads the monitor on every call, every 5s
+void lastBatReading(float &cellVoltage, float &cellPercentage);      // result of the last readBatMonitor(), for other tasks
 void loopPowerButton();
+bool powerButtonTapped();                                            // short press since the last call
@@ -0,0 +1,221 @@
+#include <Arduino.h>
+#include <stdlib.h>
+
+#include "benchmark.h"
+#include "constants.h"
+#include "soundtools.h"
+#include "inference.h"
+#include "energy.h"
+#include "pipeline.h"
+#include "adpcm.h"
+#include "cascade.h"
+#include "log.h"
+#include "heapstats.h"
+#include "resampler.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include "bleturn.h"
+#endif
+
+uint32_t cycleCount() {
+#ifdef ARDUINO_ARCH_ESP32
+  return ESP.getCycleCount();
+#elif defined(__x86_64__) || defined(__i386__)
+  return (uint32_t)__builtin_ia32_rdtsc();
+#else
+  return micros() * cyclesPerMicro();
+#endif
+}
+
+uint32_t cyclesPerMicro() {
+#ifdef ARDUINO_ARCH_ESP32
+  return ESP.getCpuFreqMHz();
+#elif defined(__x86_64__) || defined(__i386__)
+  // calibrate the TSC once against the clock
+  static uint32_t mhz = 0;
+  if (mhz == 0) {
+    uint32_t t0 = micros();
+    uint32_t c0 = cycleCount();
+    while (micros() - t0 < 20000);
+    mhz = (cycleCount() - c0) / (micros() - t0);
+  }
+  return mhz;
+#else
+  return 1;
+#endif
+}
+
+static int compareCycles(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return (x > y) - (x < y);
+}
+
+void CycleStats::report(const char* name) {
+  if (count == 0) {
+    println("   %-22s no samples", name);
+    return;
+  }
+  qsort(cycles, count, sizeof(cycles[0]), compareCycles);
+  uint32_t min = cycles[0];
+  uint32_t median = cycles[count/2];
+  uint32_t p99 = cycles[(count*99)/100 < count ? (count*99)/100 : count-1];
+  float mhz = cyclesPerMicro();
+  println("   %-22s min %9u median %9u p99 %9u cycles | %8.1f %8.1f %8.1f us",
+          name, min, median, p99, min/mhz, median/mhz, p99/mhz);
+}
+
+// sample-rate conversion of one DMA buffer from a microphone at micRate
+static void benchResampler(uint32_t micRate, const int16_t* signal, uint16_t iterations) {
+  static PolyphaseResampler resampler;
+  static CycleStats convert;
+  static int16_t out[I2S_DMA_BUF_LEN + 2];
+  if (!resampler.init(micRate, SAMPLE_RATE))
+    return;
+  convert.reset();
+  size_t produced = 0;
+  for (uint16_t it = 0;it<iterations;it++) {
+    uint32_t c = cycleCount();
+    produced += resampler.process(&signal[(it * I2S_DMA_BUF_LEN) % (SAMPLES_IN_SNIPPET - I2S_DMA_BUF_LEN)], I2S_DMA_BUF_LEN, out);
+    convert.add(cycleCount() - c);
+  }
+
+  char name[32];
+  snprintf(name, sizeof(name), "resample %u (128)", micRate);
+  convert.report(name);
+  if (convert.count > 0 && produced > 0) {
+    uint32_t median = convert.cycles[convert.count/2];
+    println("   %u/%u, %u taps: %.1f cycles per input sample, %.1f per output sample", resampler.L, resampler.M, resampler.taps,
+            (float)median / I2S_DMA_BUF_LEN, (float)median * iterations / produced);
+  }
+}
+
+// all stages are measured at the block sizes they run with in production
+void runBenchmark(uint16_t iterations) {
+  if (iterations > BENCH_MAX_ITERATIONS)
+    iterations = BENCH_MAX_ITERATIONS;
+
+  static CycleStats drain, filter, agc, gate, features, classification, inference, decision, adpcm, stage1;
+  CycleStats* all[] = { &drain, &filter, &agc, &gate, &features, &classification, &inference, &decision, &adpcm, &stage1 };
+  for (CycleStats* s : all)
+    s->reset();
+
+  // synthetic input: speech-band tone with some noise
+  static int16_t signal[SAMPLES_IN_SNIPPET];
+  generateSineWave(signal, SAMPLES_IN_SNIPPET, 700.0, 0.3);
+  for (size_t i = 0;i<SAMPLES_IN_SNIPPET;i++)
+    signal[i] += (int16_t)((i * 7919) % 2001) - 1000;
+
+  const size_t chunk = I2S_DMA_BUF_LEN;
+  const size_t sliceSize = get_slice_size();
+  static int16_t block[SAMPLES_IN_SNIPPET];
+  static SlidingEnergy energy;
+  energy.init(SAMPLES_IN_SNIPPET / sliceSize, sliceSize);
+  static float confidence[MAX_LABELS];
+  // own ring and decision engine, the capture task stays the only writer of audioRing and
+  // the live decision engine never sees the synthetic data
+  static RingBuffer<int16_t, 2048> ring;
+  static DecisionEngine engine;
+  engine.init(decisionConfig, get_no_of_labels());
+  engine.setCommand(weiter_label_no, TURN_PAGE_DOWN);
+  engine.setCommand(zurueck_label_no, TURN_PAGE_UP);
+  static AdpcmEncoder encoder;
+  static AutoGain gain;
+  gain.init(SAMPLE_RATE);
+  static uint8_t encoded[ADPCM_BLOCK_BYTES(ADPCM_BLOCK_SAMPLES)];
+  float mhz = cyclesPerMicro();
+
+  println("benchmark: %u iterations, %u MHz, slice %u samples", iterations, (uint32_t)mhz, sliceSize);
+  printInferenceInfo();
+#ifdef ARDUINO_ARCH_ESP32
+  // empty key reports, sent by the BLE sender task while the benchmark runs
+  BleNotifyTiming notifyBefore = bleStats.notify;
+  for (int i = 0;i<BLE_KEY_QUEUE_LEN/2;i++)
+    sendNoKey();
+#endif
+  uint32_t allocationsBefore = heapAllocations();
+  for (uint16_t it = 0;it<iterations;it++) {
+    size_t offset = (it * sliceSize) % (SAMPLES_IN_SNIPPET - sliceSize);
+
+    // I2S drain: one DMA buffer into a ring of the same kind
+    uint32_t c = cycleCount();
+    ring.write(&signal[(it * chunk) % (SAMPLES_IN_SNIPPET - chunk)], chunk);
+    drain.add(cycleCount() - c);
+
+    // filtering of one slice
+    memcpy(block, &signal[offset], sliceSize * sizeof(int16_t));
+    c = cycleCount();
+    filterAudio(block, sliceSize);
+    filter.add(cycleCount() - c);
+
+    // silence gate, incremental per slice
+    c = cycleCount();
+    energy.addSlice(block, sliceSize);
+    volatile bool silent = energy.isBelow(SILENCE_MEAN_SQUARE);
+    (void)silent;
+    gate.add(cycleCount() - c);
+
+    // cascade stage 1: shared slice features and speech-likeness test
+    static SliceFeatures sliceFeatures;
+    c = cycleCount();
+    computeSliceFeatures(block, sliceSize, sliceFeatures);
+    volatile bool speechLike = cascadeNeedsClassifier(sliceFeatures);
+    (void)speechLike;
+    stage1.add(cycleCount() - c);
+
+    // gain control of one slice, detector filter and gain in one pass
+    c = cycleCount();
+    gain.processBlock(block, sliceSize);
+    agc.add(cycleCount() - c);
+
+    // feature extraction and NN inference of one slice, split as reported by the SDK
+    int pred_no;
+    c = cycleCount();
+    runInferenceSlice(block, confidence, pred_no);
+    inference.add(cycleCount() - c);
+    features.add(lastInferenceTiming.dsp_us * mhz);
+    classification.add(lastInferenceTiming.classification_us * mhz);
+
+    // decision state machine
+    c = cycleCount();
+    engine.update(confidence, millis());
+    decision.add(cycleCount() - c);
+
+    // ADPCM encoding of one upload block
+    c = cycleCount();
+    encoder.encodeBlock(&signal[(it * ADPCM_BLOCK_SAMPLES) % (SAMPLES_IN_SNIPPET - ADPCM_BLOCK_SAMPLES)], ADPCM_BLOCK_SAMPLES, encoded);
+    adpcm.add(cycleCount() - c);
+  }
+
+  drain.report("I2S drain (128)");
+  filter.report("filter (slice)");
+  agc.report("AGC (slice)");
+  if (agc.count > 0)
+    println("   AGC: %.1f cycles per sample, gain %.2f", (float)agc.cycles[agc.count/2] / sliceSize, (float)gain.gain / AGC_UNITY);
+  gate.report("RMS gate (slice)");
+  stage1.report("cascade stage 1");
+  features.report("feature extraction");
+  classification.report("NN inference");
+  inference.report("inference total");
+  println("   classifier arena: peak %u bytes (%u in PSRAM)", inferenceArena.peakBytes, inferenceArena.psramBytes);
+  decision.report("decision engine");
+#ifdef ARDUINO_ARCH_ESP32
+  uint32_t notifies = bleStats.notify.count - notifyBefore.count;
+  if (notifies > 0)
+    println("   %-22s mean %9.1f us over %u empty reports, sender task", "BLE notify",
+            (float)(bleStats.notify.total_us - notifyBefore.total_us) / notifies, notifies);
+  else
+    println("   %-22s no reports sent (not connected)", "BLE notify");
+#endif
+  adpcm.report("ADPCM encode (1024)");
+  if (adpcm.count > 0)
+    println("   ADPCM encoder: %u cycles per second of audio", (uint32_t)((uint64_t)adpcm.cycles[adpcm.count/2] * SAMPLE_RATE / ADPCM_BLOCK_SAMPLES));
+  benchResampler(48000, signal, iterations);
+  benchResampler(44100, signal, iterations);
+  printLogStats();
+  if (heapTraceEnabled())
+    println("   heap: %.2f allocations per iteration", (float)(heapAllocations() - allocationsBefore) / iterations);
+  printHeapStats();
+
+  // the continuous classifier has seen the synthetic slices
+  initPipeline();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define BENCH_MAX_ITERATIONS 256
+
+// cycle counter of the cpu (ESP.getCycleCount() on the device, TSC or clock on the host)
+uint32_t cycleCount();
+// cpu cycles per microsecond
+uint32_t cyclesPerMicro();
+
+// collects the cycles of one stage over the iterations of a benchmark run
+struct CycleStats {
+  uint32_t cycles[BENCH_MAX_ITERATIONS];
+  uint16_t count = 0;
+
+  void reset() { count = 0; }
+  void add(uint32_t c) {
+    if (count < BENCH_MAX_ITERATIONS)
+      cycles[count++] = c;
+  }
+  // print min/median/p99 in cycles and µs
+  void report(const char* name);
+};
+
+// run every audio stage iterations times on a synthetic signal and print the statistics
+void runBenchmark(uint16_t iterations);
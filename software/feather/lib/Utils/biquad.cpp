@@ -0,0 +1,107 @@
+#include <Arduino.h>
+#include "biquad.h"
+
+#ifdef BIQUAD_USE_ESP_DSP
+#include <dsps_biquad.h>
+#endif
+
+bool BiquadCascade::addSection(BiquadModeType mode, float fc, float fs) {
+  if (sections >= BIQUAD_MAX_SECTIONS)
+    return false;
+
+  // pre-warp and compute analog prototype
+  float w0 = 2.0f * M_PI * fc / fs;
+  float K  = tanf(w0 / 2.0f);
+  float norm = 1.0f / (1.0f + sqrtf(2.0f)*K + K*K);
+  float b0f, b1f, b2f;
+  if (mode == BIQUAD_LOWPASS) {
+    b0f =  K*K * norm;
+    b1f =  2.0f * b0f;
+    b2f =  b0f;
+  } else {
+    b0f =  1.0f * norm;
+    b1f = -2.0f * b0f;
+    b2f =  b0f;
+  }
+  float a1f =  2.0f * (K*K - 1.0f) * norm;
+  float a2f =  (1.0f - sqrtf(2.0f)*K + K*K) * norm;
+
+  uint8_t s = sections;
+  const float scale = (float)(1 << BIQUAD_Q);
+  b0[s] = (int32_t)roundf(b0f * scale);
+  b1[s] = (int32_t)roundf(b1f * scale);
+  b2[s] = (int32_t)roundf(b2f * scale);
+  a1[s] = (int32_t)roundf(a1f * scale);
+  a2[s] = (int32_t)roundf(a2f * scale);
+
+#ifdef BIQUAD_USE_ESP_DSP
+  coef[s][0] = b0f;
+  coef[s][1] = b1f;
+  coef[s][2] = b2f;
+  coef[s][3] = a1f;
+  coef[s][4] = a2f;
+#endif
+
+  sections++;
+  reset();
+  return true;
+}
+
+void BiquadCascade::reset() {
+  for (int s = 0;s<BIQUAD_MAX_SECTIONS;s++) {
+    x1[s] = x2[s] = y1[s] = y2[s] = 0;
+#ifdef BIQUAD_USE_ESP_DSP
+    w[s][0] = w[s][1] = 0;
+#endif
+  }
+}
+
+#ifdef BIQUAD_USE_ESP_DSP
+
+// ESP-DSP works on float, convert in chunks that fit on the stack
+void BiquadCascade::processBlock(int16_t* buffer, size_t len) {
+  const size_t chunk = 128;
+  float f[chunk];
+  for (size_t start = 0; start < len; start += chunk) {
+    size_t n = (len - start < chunk) ? len - start : chunk;
+    for (size_t i = 0;i<n;i++)
+      f[i] = buffer[start + i];
+    for (uint8_t s = 0;s<sections;s++)
+      dsps_biquad_f32(f, f, n, coef[s], w[s]);
+    for (size_t i = 0;i<n;i++) {
+      float v = f[i];
+      if (v >  32767.0f) v =  32767.0f;
+      if (v < -32768.0f) v = -32768.0f;
+      buffer[start + i] = (int16_t)v;
+    }
+  }
+}
+
+#else
+
+// portable fixed-point version, one pass over the block per section
+void BiquadCascade::processBlock(int16_t* buffer, size_t len) {
+  for (uint8_t s = 0;s<sections;s++) {
+    // coefficients and delay line are kept in locals (registers) for the whole block
+    const int32_t cb0 = b0[s], cb1 = b1[s], cb2 = b2[s], ca1 = a1[s], ca2 = a2[s];
+    int32_t sx1 = x1[s], sx2 = x2[s], sy1 = y1[s], sy2 = y2[s];
+
+    for (size_t i = 0;i<len;i++) {
+      int32_t x0 = buffer[i];
+      int64_t acc = (int64_t)cb0 * x0 + (int64_t)cb1 * sx1 + (int64_t)cb2 * sx2
+                  - (int64_t)ca1 * sy1 - (int64_t)ca2 * sy2;
+      int32_t y0 = (int32_t)(acc >> BIQUAD_Q);
+      if (y0 >  32767) y0 =  32767;
+      if (y0 < -32768) y0 = -32768;
+
+      sx2 = sx1; sx1 = x0;
+      sy2 = sy1; sy1 = y0;
+      buffer[i] = (int16_t)y0;
+    }
+
+    x1[s] = sx1; x2[s] = sx2;
+    y1[s] = sy1; y2[s] = sy2;
+  }
+}
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Arduino.h>
+
+// use the ESP-DSP kernels if the framework ships them, otherwise the portable fixed-point code
+#if defined(ESP_PLATFORM) && !defined(BIQUAD_NO_ESP_DSP) && __has_include(<dsps_biquad.h>)
+#define BIQUAD_USE_ESP_DSP
+#endif
+
+#define BIQUAD_MAX_SECTIONS 4
+#define BIQUAD_Q 14                     // coefficients in Q14, |a1| of a 2nd order section goes up to 2
+
+enum BiquadModeType { BIQUAD_LOWPASS, BIQUAD_HIGHPASS };
+
+// Cascade of 2nd-order Butterworth sections, processed block-wise.
+// The delay line of each section stays in registers for the whole block.
+struct BiquadCascade {
+  uint8_t sections = 0;
+
+  // fixed-point coefficients and state (Direct Form I)
+  int32_t b0[BIQUAD_MAX_SECTIONS], b1[BIQUAD_MAX_SECTIONS], b2[BIQUAD_MAX_SECTIONS];
+  int32_t a1[BIQUAD_MAX_SECTIONS], a2[BIQUAD_MAX_SECTIONS];
+  int32_t x1[BIQUAD_MAX_SECTIONS], x2[BIQUAD_MAX_SECTIONS];
+  int32_t y1[BIQUAD_MAX_SECTIONS], y2[BIQUAD_MAX_SECTIONS];
+
+#ifdef BIQUAD_USE_ESP_DSP
+  // ESP-DSP format: b0, b1, b2, a1, a2 and Direct Form II state
+  float coef[BIQUAD_MAX_SECTIONS][5];
+  float w[BIQUAD_MAX_SECTIONS][2];
+#endif
+
+  // remove all sections
+  void clear() { sections = 0; }
+
+  // add a 2nd-order Butterworth low- or high-pass section with cutoff fc [Hz] at sample rate fs [Hz]
+  bool addSection(BiquadModeType mode, float fc, float fs);
+
+  // zero the delay lines
+  void reset();
+
+  // filter len samples in place through all sections
+  void processBlock(int16_t* buffer, size_t len);
+};
@@ -1,5 +1,6 @@
 #include <Arduino.h>
 #include "bleturn.h"
+#include "constants.h"
 
 
 #include <NimBLEDevice.h>
@@ -7,12 +8,96 @@
 
 NimBLEServer *pServer;
 NimBLEHIDDevice *hid;
-NimBLECharacteristic *input;
+NimBLECharacteristic *input;                // keyboard input report, looked up once
+
+BleStats bleStats;
+
+#define KEY_PAGE_UP 0x4B                    // HID usage codes
+#define KEY_PAGE_DOWN 0x4E
+#define KEY_NONE 0x00
+
+// a queued key and when it was decided
+struct KeyEvent {
+  uint8_t key;
+  uint32_t decision_us;
+};
+
+static QueueHandle_t keyQueue = NULL;
+static uint16_t connHandle = 0;
+static volatile uint32_t pendingPress_us = 0;    // decision time of the press that waits for its status
+
+static const uint8_t releaseReport[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+static void requestConnParams(bool active) {
+  if (!bleStats.connected)
+    return;
+  if (active)
+    pServer->updateConnParams(connHandle, BLE_ACTIVE_MIN_INTERVAL, BLE_ACTIVE_MAX_INTERVAL, BLE_ACTIVE_LATENCY, BLE_SUPERVISION_TIMEOUT);
+  else
+    pServer->updateConnParams(connHandle, BLE_IDLE_MIN_INTERVAL, BLE_IDLE_MAX_INTERVAL, BLE_IDLE_LATENCY, BLE_SUPERVISION_TIMEOUT);
+}
+
+class ServerCallbacks : public NimBLEServerCallbacks {
+  void onConnect(NimBLEServer* server, NimBLEConnInfo& info) override {
+    connHandle = info.getConnHandle();
+    bleStats.connected = true;
+    bleStats.connInterval = info.getConnInterval();
+    requestConnParams(bleStats.activeMode);
+  }
+  void onDisconnect(NimBLEServer* server, NimBLEConnInfo& info, int reason) override {
+    bleStats.connected = false;
+    bleStats.connInterval = 0;
+  }
+  void onConnParamsUpdate(NimBLEConnInfo& info) override {
+    bleStats.connInterval = info.getConnInterval();
+  }
+};
+
+// the stack reports a sent notification, the first one after a press is the press itself
+class InputCallbacks : public NimBLECharacteristicCallbacks {
+  void onStatus(NimBLECharacteristic* characteristic, int code) override {
+    uint32_t decision = pendingPress_us;
+    if ((decision != 0) && (code == 0)) {
+      bleStats.decisionToComplete.add(micros() - decision);
+      pendingPress_us = 0;
+    }
+  }
+};
+
+static void notifyKey(uint8_t key) {
+  uint8_t press[8] = {0x00, 0x00, key, 0x00, 0x00, 0x00, 0x00, 0x00};
+  input->setValue(press, sizeof(press));
+  input->notify();
+  input->setValue(releaseReport, sizeof(releaseReport));
+  input->notify();
+}
+
+// sends the queued keys, blocks only itself
+static void bleSenderTask(void* param) {
+  KeyEvent event;
+  while (true) {
+    if (xQueueReceive(keyQueue, &event, portMAX_DELAY) != pdTRUE)
+      continue;
+    if (!bleStats.connected)
+      continue;
+    if (event.key != KEY_NONE)
+      pendingPress_us = event.decision_us;
+    uint32_t start_us = micros();
+    notifyKey(event.key);
+    bleStats.notify.total_us += micros() - start_us;
+    bleStats.notify.count++;
+    if (event.key == KEY_NONE)
+      continue;
+    bleStats.decisionToNotify.add(micros() - event.decision_us);
+    bleStats.keysSent++;
+  }
+}
 
 void initBLE() {
   NimBLEDevice::init("Tiny Turner");
 
   pServer = NimBLEDevice::createServer();
+  pServer->setCallbacks(new ServerCallbacks());
   hid = new NimBLEHIDDevice(pServer);
 
   // Required HID setup
@@ -29,6 +114,10 @@ void initBLE() {
   };
   hid->setReportMap((uint8_t*)reportMap, sizeof(reportMap));
 
+  // the input report is used for every key, no lookup per key
+  input = hid->getInputReport(1); // Report ID 1 for Keyboard
+  input->setCallbacks(new InputCallbacks());
+
   // Start HID services
   hid->startServices();
 
@@ -38,27 +127,51 @@ void initBLE() {
   pAdvertising->addServiceUUID(hid->getHidService()->getUUID());
   pAdvertising->start();
 
-  Serial.println("BLE HID Keyboard Ready!");
+  keyQueue = xQueueCreate(BLE_KEY_QUEUE_LEN, sizeof(KeyEvent));
+  xTaskCreatePinnedToCore(bleSenderTask, "bleSend", 4096, NULL, BLE_TASK_PRIORITY, NULL, BLE_TASK_CORE);
+
+  println("BLE HID Keyboard Ready!");
 }
 
-void sendKey(uint8_t key) {
-  uint8_t msg[] = {0x00, 0x00, key, 0x00, 0x00, 0x00, 0x00, 0x00};
-  input = hid->getInputReport(1); // Report ID 1 for Keyboard
-  input->setValue(msg, sizeof(msg));
-  input->notify();
+// queue a key, returns immediately
+static void queueKey(uint8_t key) {
+  KeyEvent event = { key, micros() };
+  if (xQueueSend(keyQueue, &event, 0) == pdTRUE)
+    bleStats.keysQueued++;
+  else
+    bleStats.keysDropped++;
+}
 
-  // Release key
-  uint8_t release[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-  input->setValue(release, sizeof(release));
-  input->notify();
+// press and release of no key, has no effect on the host (used for benchmarking the notify).
+// Goes through the sender task like every key, so nothing else notifies on the characteristic.
+void sendNoKey() {
+  KeyEvent event = { KEY_NONE, micros() };
+  xQueueSend(keyQueue, &event, 0);
 }
 
 void sendPageUp() {
-  sendKey(0x4B); // HID code for Page Up
-  Serial.println("Sent: PAGE UP");
+  queueKey(KEY_PAGE_UP);
+  println("Sent: PAGE UP");
 }
 
 void sendPageDown() {
-  sendKey(0x4E); // HID code for Page Down
-  Serial.println("Sent: PAGE DOWN");
+  queueKey(KEY_PAGE_DOWN);
+  println("Sent: PAGE DOWN");
+}
+
+void setBleActive(bool active) {
+  if (active == bleStats.activeMode)
+    return;
+  bleStats.activeMode = active;
+  requestConnParams(active);
+}
+
+void printBleStats() {
+  println("BLE: %s, interval %.2fms (%s mode), %u keys queued, %u sent, %u dropped",
+          bleStats.connected ? "connected" : "not connected", bleStats.connInterval * 1.25f,
+          bleStats.activeMode ? "active" : "idle", bleStats.keysQueued, bleStats.keysSent, bleStats.keysDropped);
+  println("   decision to notify   mean %6.0fus max %6uus (%u keys)",
+          bleStats.decisionToNotify.mean_us(), bleStats.decisionToNotify.max_us, bleStats.decisionToNotify.count);
+  println("   decision to sent     mean %6.0fus max %6uus (%u keys)",
+          bleStats.decisionToComplete.mean_us(), bleStats.decisionToComplete.max_us, bleStats.decisionToComplete.count);
 }
@@ -1,5 +1,49 @@
 #pragma once
 
+#include <Arduino.h>
+#include "pipeline.h"
+
+// BLE HID keyboard with a latency mode: page turns are queued and notified by a sender task, so
+// the inference loop never waits for the radio. While the player is active a short connection
+// interval is requested, when idle a relaxed one to save power.
+
+#define BLE_KEY_QUEUE_LEN 8
+#define BLE_TASK_PRIORITY 5                 // above loop(), the notify has to go out right away
+#define BLE_TASK_CORE 1
+
+// connection parameters in units of 1.25ms (interval) and 10ms (supervision timeout)
+#define BLE_ACTIVE_MIN_INTERVAL 6           // 7.5ms
+#define BLE_ACTIVE_MAX_INTERVAL 12          // 15ms
+#define BLE_ACTIVE_LATENCY 0
+#define BLE_IDLE_MIN_INTERVAL 40            // 50ms
+#define BLE_IDLE_MAX_INTERVAL 80            // 100ms
+#define BLE_IDLE_LATENCY 4                  // the peripheral may skip 4 intervals
+#define BLE_SUPERVISION_TIMEOUT 400         // 4s
+#define BLE_ACTIVE_HOLD_MS 60000            // active mode lasts this long after the last speech-like sound
+
+// time the sender task spends in the two notifies of a key
+struct BleNotifyTiming {
+  uint64_t total_us = 0;
+  uint32_t count = 0;
+};
+
+// latency of a page turn, measured from the decision
+struct BleStats {
+  uint32_t keysQueued = 0;
+  uint32_t keysDropped = 0;                 // queue full
+  uint32_t keysSent = 0;
+  uint16_t connInterval = 0;                // [1.25ms] as negotiated, 0 if not connected
+  bool connected = false;
+  bool activeMode = false;
+  StageTime decisionToNotify;               // decision until both reports are handed to the stack
+  StageTime decisionToComplete;             // decision until the stack reports the key press as sent
+  BleNotifyTiming notify;                   // all keys, the empty ones of the benchmark included
+};
+extern BleStats bleStats;
+
 void initBLE();
 void sendPageUp();
-void sendPageDown();
\ No newline at end of file
+void sendPageDown();
+void sendNoKey();                           // queue an empty key report, has no effect on the host
+void setBleActive(bool active);             // short connection interval while the player is active
+void printBleStats();
@@ -6,9 +6,7 @@
 Adafruit_NeoPixel pixel(NUMPIXELS, PIN_NEOPIXEL, NEO_GRB + NEO_KHZ800);
 PixelModeType pixelMode  = PIX_NO_MODE;
 
-static uint32_t lastUpdateTime = millis();
-static uint32_t updateFrequency = 50; // [ms]
-static uint32_t cycleStart = lastUpdateTime - updateFrequency; // take care that the first call of loop does something
+static uint32_t cycleStart = 0;                   // start of the blink cycle
 
 // initialise the neopixel 
 void initNeoPixel() {
@@ -44,9 +42,6 @@ void setNeoPixelMode(PixelModeType mode) {
 
 void loopNeoPixel() {
     uint32_t now = millis();
-    if (now - lastUpdateTime < updateFrequency)
-        return;
-    lastUpdateTime = now;
 
     switch(pixelMode) {
         case PIX_PRODUCTION_MODE: {
@@ -3,6 +3,6 @@
 
 enum PixelModeType { PIX_PRODUCTION_MODE, PIX_SETUP_MODE,PIX_NO_MODE };
 
-void loopNeoPixel();
+void loopNeoPixel();                                // every 50ms
 void setNeoPixelMode(PixelModeType mode);
 void initNeoPixel();
\ No newline at end of file
@@ -0,0 +1,32 @@
+#include <Arduino.h>
+#include "boot.h"
+#include "log.h"
+
+BootStats bootStats;
+
+static const char* stageName[BOOT_STAGES] = { "core", "audio", "ble", "ready", "online" };
+
+void bootStageDone(BootStage stage) {
+  bootStats.stageMs[stage] = millis();
+  println("boot: %s after %ums", stageName[stage], bootStats.stageMs[stage]);
+  if ((stage == BOOT_READY) && (bootStats.stageMs[stage] > BOOT_BUDGET_MS))
+    logWarn("boot took %ums, budget is %ums", bootStats.stageMs[stage], BOOT_BUDGET_MS);
+}
+
+bool isBootStageDone(BootStage stage) {
+  return bootStats.stageMs[stage] != 0;
+}
+
+void markFirstInference() {
+  if (bootStats.firstInferenceMs != 0)
+    return;
+  bootStats.firstInferenceMs = millis();
+  println("boot: first inference after %ums", bootStats.firstInferenceMs);
+}
+
+void printBootStats() {
+  print("boot [ms]:");
+  for (int i = 0; i < BOOT_STAGES; i++)
+    print(" %s %u", stageName[i], bootStats.stageMs[i]);
+  println(", first inference %u (budget %u)", bootStats.firstInferenceMs, BOOT_BUDGET_MS);
+}
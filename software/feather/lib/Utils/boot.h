@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Staged startup: everything needed to turn pages (audio, inference, BLE) comes up first,
+// WiFi, backend and captive portal follow in a background task. Page turning works offline.
+
+#define BOOT_BUDGET_MS 2000                 // [ms] since reset until the page turner has to be ready
+
+enum BootStage { BOOT_CORE, BOOT_AUDIO, BOOT_BLE, BOOT_READY, BOOT_ONLINE, BOOT_STAGES };
+
+struct BootStats {
+  uint32_t stageMs[BOOT_STAGES] = { 0 };    // [ms] since reset when the stage was finished, 0 if not yet
+  uint32_t firstInferenceMs = 0;            // [ms] since reset until the first classified slice
+};
+extern BootStats bootStats;
+
+void bootStageDone(BootStage stage);
+void markFirstInference();
+bool isBootStageDone(BootStage stage);
+void printBootStats();
@@ -0,0 +1,66 @@
+#include <Arduino.h>
+#include "cascade.h"
+#include "constants.h"
+#include "energy.h"
+#include "biquad.h"
+
+CascadeConfig cascadeConfig;
+CascadeStats cascadeStats;
+
+static BiquadCascade bandFilter;                       // own state, the slices are filtered out of order with the audio
+static float backgroundLevel = SILENCE_MEAN_SQUARE;    // tracked mean square of the background
+static uint16_t slicesSinceTrigger = 0xFFFF;
+
+void initCascade() {
+  bandFilter.clear();
+  bandFilter.addSection(BIQUAD_HIGHPASS, 300.0f, SAMPLE_RATE);
+  bandFilter.addSection(BIQUAD_LOWPASS, 3400.0f, SAMPLE_RATE);
+  backgroundLevel = SILENCE_MEAN_SQUARE;
+  slicesSinceTrigger = 0xFFFF;
+}
+
+void computeSliceFeatures(const int16_t* slice, size_t len, SliceFeatures &f) {
+  static int16_t band[SAMPLES_IN_SNIPPET];
+  if (len > SAMPLES_IN_SNIPPET)
+    len = SAMPLES_IN_SNIPPET;
+
+  f.samples = len;
+  f.energy = sumOfSquares(slice, len);
+
+  uint32_t crossings = 0;
+  for (size_t i = 1;i<len;i++)
+    crossings += (slice[i-1] ^ slice[i]) < 0;
+  f.zeroCrossings = crossings;
+
+  memcpy(band, slice, len * sizeof(int16_t));
+  bandFilter.processBlock(band, len);
+  f.bandEnergy = sumOfSquares(band, len);
+}
+
+bool cascadeNeedsClassifier(const SliceFeatures &f) {
+  cascadeStats.slices++;
+
+  float meanSquare = (float)f.energy / f.samples;
+  float bandRatio = (f.energy > 0) ? (float)f.bandEnergy / f.energy : 0;
+  float zcr = (float)f.zeroCrossings / f.samples;
+  bool speechLike = (meanSquare > SILENCE_MEAN_SQUARE) && (meanSquare > cascadeConfig.onsetFactor * backgroundLevel) &&
+                    (bandRatio >= cascadeConfig.minBandRatio) &&
+                    (zcr >= cascadeConfig.minZcr) && (zcr <= cascadeConfig.maxZcr);
+
+  // the background follows drops quickly and rises slowly (~10s), so sustained music raises the bar
+  if (meanSquare < backgroundLevel)
+    backgroundLevel += 0.3f * (meanSquare - backgroundLevel);
+  else
+    backgroundLevel += 0.01f * (meanSquare - backgroundLevel);
+  if (backgroundLevel < 1.0f)
+    backgroundLevel = 1.0f;
+
+  if (speechLike) {
+    cascadeStats.stage1Triggers++;
+    slicesSinceTrigger = 0;
+  } else if (slicesSinceTrigger < 0xFFFF) {
+    slicesSinceTrigger++;
+  }
+  // stage 1 is evaluated anyway so the trigger counters are comparable with the cascade off
+  return !cascadeConfig.enabled || (slicesSinceTrigger <= cascadeConfig.holdSlices);
+}
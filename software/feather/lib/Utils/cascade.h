@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Two-stage detector: a cheap speech-likeness test runs on every slice, the full classifier
+// (stage 2) only runs while stage 1 has fired within the last holdSlices slices.
+// Stage 1 uses the features of the shared front end below, the silence gate uses the same energy.
+
+// per-slice features, computed once per slice and shared by the silence gate and stage 1
+struct SliceFeatures {
+  uint64_t energy;                      // sum of squares
+  uint64_t bandEnergy;                  // sum of squares within 300-3400Hz
+  uint32_t zeroCrossings;
+  uint32_t samples;
+};
+
+struct CascadeConfig {
+  bool enabled = true;
+  float minBandRatio = 0.5;             // share of the energy in the speech band
+  float minZcr = 0.01;                  // zero crossings per sample, speech lies in between
+  float maxZcr = 0.35;
+  float onsetFactor = 2.0;              // slice energy above the tracked background level
+  uint16_t holdSlices = 15;             // stage 2 keeps running this long after the last trigger
+};
+extern CascadeConfig cascadeConfig;
+
+struct CascadeStats {
+  uint32_t slices = 0;                  // slices seen by stage 1
+  uint32_t stage1Triggers = 0;          // slices stage 1 considered speech-like
+  uint32_t stage2Activations = 0;       // times stage 2 has been switched on and refilled its window
+  uint32_t stage2Runs = 0;              // classifier runs, including the refill after an activation
+  uint32_t stage2Triggers = 0;          // page turns decided by stage 2
+};
+extern CascadeStats cascadeStats;
+
+void initCascade();
+void computeSliceFeatures(const int16_t* slice, size_t len, SliceFeatures &f);
+
+// stage 1 on the features of one slice, true if stage 2 has to classify the slice
+bool cascadeNeedsClassifier(const SliceFeatures &f);
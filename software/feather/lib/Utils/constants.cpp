@@ -1,23 +1,19 @@
 #include <Arduino.h>
 #include <HardwareSerial.h> 
 #include "constants.h"
+#include "log.h"
 
 
 void println(const char* format, ...) {
-    char s[256];
  	  __gnuc_va_list  args;		
     va_start(args, format);
-    vsprintf (s, format, args);
+    logMessage(LOG_INFO, true, format, args);
     va_end(args);
-    Serial.println(s);
 };
 
 void print(const char* format, ...) {
-    char s[256];
  	  __gnuc_va_list  args;		
     va_start(args, format);
-    vsprintf (s, format, args);
+    logMessage(LOG_INFO, false, format, args);
     va_end(args);
-    Serial.print(s);
 };
-
@@ -6,7 +6,7 @@ void println(const char* format, ...);
 void print(const char* format, ...);
 
 
-#define VERSION 7
+#define VERSION 8
 const uint16_t version = VERSION;
 
 #if CONFIG_IDF_TARGET_ESP32S3
@@ -47,5 +47,23 @@ const uint16_t version = VERSION;
 #define SAMPLES_IN_SNIPPET SAMPLE_RATE
 #define BYTES_PER_SAMPLE  2       // bytes per sample
 
-// backend url or IP address
-extern String serverUrl;
+// native rate of the microphone, the capture task resamples it to SAMPLE_RATE (resampler.h).
+// The ICS43434 of the S3 boards does not go below 23 kHz.
+#ifndef MIC_SAMPLE_RATE
+#ifdef BOARD_IS_FEATHER_S3
+#define MIC_SAMPLE_RATE 48000
+#else
+#define MIC_SAMPLE_RATE SAMPLE_RATE
+#endif
+#endif
+
+// I2S microphone, captured by a dedicated task on core 0 (loop() runs on core 1)
+#define I2S_PORT I2S_NUM_0
+#define I2S_SCK_PIN 14
+#define I2S_WS_PIN 25
+#define I2S_SD_PIN 26
+#define I2S_DMA_BUF_COUNT 8                 // number of DMA descriptors
+#define I2S_DMA_BUF_LEN 128                 // [samples] per DMA descriptor, 8ms
+#define AUDIO_CAPTURE_CORE 0
+#define AUDIO_CAPTURE_PRIORITY 10           // above loop() (1), DMA buffers bridge WiFi bursts
+#define AUDIO_CAPTURE_STACK_SIZE 4096
@@ -0,0 +1,76 @@
+#include <Arduino.h>
+#include "decision.h"
+
+void DecisionEngine::init(const DecisionConfig &cfg, uint8_t labelCount) {
+  config = cfg;
+  if (config.window < 1)
+    config.window = 1;
+  if (config.window > DECISION_MAX_WINDOW)
+    config.window = DECISION_MAX_WINDOW;
+  labels = (labelCount > MAX_LABELS) ? MAX_LABELS : labelCount;
+  for (uint8_t i = 0;i<MAX_LABELS;i++)
+    command[i] = TURN_NONE;
+  reset();
+}
+
+void DecisionEngine::reset() {
+  for (uint8_t i = 0;i<MAX_LABELS;i++) {
+    smoothedProb[i] = 0;
+    armed[i] = true;
+    fired[i] = false;
+    lastFired_ms[i] = 0;
+  }
+  historyPos = 0;
+  historyLen = 0;
+  lastFiredLabel = -1;
+}
+
+void DecisionEngine::setCommand(uint16_t label, PageTurnType turn) {
+  if (label < labels)
+    command[label] = turn;
+}
+
+PageTurnType DecisionEngine::update(const float* probabilities, uint32_t now_ms) {
+  // smoothing of the posteriors
+  if (config.smoothing == SMOOTH_EMA) {
+    for (uint8_t i = 0;i<labels;i++)
+      smoothedProb[i] += config.emaAlpha * (probabilities[i] - smoothedProb[i]);
+  } else {
+    memcpy(history[historyPos], probabilities, labels * sizeof(float));
+    historyPos = (historyPos + 1) % config.window;
+    if (historyLen < config.window)
+      historyLen++;
+
+    // summed up again every time, a running sum would drift; a shorter history counts as zeros
+    for (uint8_t i = 0;i<labels;i++) {
+      float sum = 0;
+      for (uint8_t h = 0;h<historyLen;h++)
+        sum += history[h][i];
+      smoothedProb[i] = sum / config.window;
+    }
+  }
+
+  // hysteresis and refractory period per command, the most likely command wins
+  PageTurnType turn = TURN_NONE;
+  float best = 0;
+  int16_t bestLabel = -1;
+  for (uint8_t i = 0;i<labels;i++) {
+    if (command[i] == TURN_NONE)
+      continue;
+    if (smoothedProb[i] < config.offThreshold)
+      armed[i] = true;
+    bool refractory = fired[i] && (now_ms - lastFired_ms[i] < config.refractory_ms);
+    if (armed[i] && !refractory && (smoothedProb[i] >= config.onThreshold) && (smoothedProb[i] > best)) {
+      best = smoothedProb[i];
+      bestLabel = i;
+    }
+  }
+  if (bestLabel >= 0) {
+    armed[bestLabel] = false;
+    fired[bestLabel] = true;
+    lastFired_ms[bestLabel] = now_ms;
+    lastFiredLabel = bestLabel;
+    turn = command[bestLabel];
+  }
+  return turn;
+}
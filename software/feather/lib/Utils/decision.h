@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+#include "constants.h"
+
+// Decision engine: turns the stream of per-label probability vectors of the classifier into page turns.
+// The posteriors are smoothed over time (EMA or moving average over the last inferences), a command
+// fires as soon as its smoothed probability crosses the on-threshold and is re-armed only after it
+// fell below the off-threshold (hysteresis) and its refractory period is over.
+
+enum PageTurnType { TURN_NONE, TURN_PAGE_DOWN, TURN_PAGE_UP };
+
+enum SmoothingType { SMOOTH_EMA, SMOOTH_WINDOW };
+
+#define DECISION_MAX_WINDOW 16                    // [inferences] longest moving average
+
+struct DecisionConfig {
+  SmoothingType smoothing = SMOOTH_EMA;
+  float emaAlpha = 0.5;                           // weight of the newest inference
+  uint8_t window = 3;                             // [inferences] length of the moving average
+  float onThreshold = 0.7;                        // smoothed probability that fires a command
+  float offThreshold = 0.4;                       // command is re-armed below this
+  uint32_t refractory_ms = 1500;                  // minimum time between two turns of the same command
+};
+
+class DecisionEngine {
+  public:
+    void init(const DecisionConfig &config, uint8_t labels);
+    void reset();
+
+    // map a label to a page turn, labels without a command never fire
+    void setCommand(uint16_t label, PageTurnType turn);
+
+    // feed the probability vector of one inference, returns the page turn if a command fired
+    PageTurnType update(const float* probabilities, uint32_t now_ms);
+
+    const DecisionConfig& getConfig() const { return config; }
+    float smoothed(uint16_t label) const { return (label < labels) ? smoothedProb[label] : 0.0; }
+    int16_t firedLabel() const { return lastFiredLabel; }    // label of the last command that fired
+
+  private:
+    DecisionConfig config;
+    uint8_t labels = 0;
+    PageTurnType command[MAX_LABELS];
+    float smoothedProb[MAX_LABELS];
+    float history[DECISION_MAX_WINDOW][MAX_LABELS];
+    uint8_t historyPos = 0;
+    uint8_t historyLen = 0;
+    bool armed[MAX_LABELS];
+    bool fired[MAX_LABELS];                       // fired at least once, refractory period applies
+    uint32_t lastFired_ms[MAX_LABELS];
+    int16_t lastFiredLabel = -1;
+};
@@ -0,0 +1,24 @@
+#include <Arduino.h>
+#include "energy.h"
+
+// Unrolled by 4 with independent accumulators, so the compiler can keep the
+// multiplies in flight (MULL/MULSH on Xtensa, vectorised on host)
+uint64_t sumOfSquares(const int16_t* samples, size_t len) {
+  uint64_t acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0;
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    int32_t s0 = samples[i];
+    int32_t s1 = samples[i+1];
+    int32_t s2 = samples[i+2];
+    int32_t s3 = samples[i+3];
+    acc0 += (uint32_t)(s0 * s0);
+    acc1 += (uint32_t)(s1 * s1);
+    acc2 += (uint32_t)(s2 * s2);
+    acc3 += (uint32_t)(s3 * s3);
+  }
+  for (; i < len; i++) {
+    int32_t s = samples[i];
+    acc0 += (uint32_t)(s * s);
+  }
+  return acc0 + acc1 + acc2 + acc3;
+}
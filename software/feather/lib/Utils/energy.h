@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Arduino.h>
+
+// maximum number of slices a sliding energy window can consist of
+#define ENERGY_MAX_SLICES 32
+
+// silence gate on the mean square of int16 samples, 0.0006 of full scale (RMS 0.0245)
+#define SILENCE_MEAN_SQUARE 644245
+
+// sum of squares of int16 samples, integer only (32x32->64 MAC)
+uint64_t sumOfSquares(const int16_t* samples, size_t len);
+
+// Energy of a sliding window that moves in slices. Adding a slice subtracts the slice
+// that falls out of the window, so the gate costs O(slice) instead of O(window).
+struct SlidingEnergy {
+  uint64_t sliceSum[ENERGY_MAX_SLICES];         // sum of squares per slice in the window
+  uint64_t total;                               // sum of squares of the whole window
+  uint32_t samplesPerSlice;
+  uint16_t slicesPerWindow;
+  uint16_t next;                                // slot of the oldest slice
+  uint16_t filled;                              // number of slices in the window so far
+
+  void init(uint16_t slices, uint32_t sliceSamples) {
+    slicesPerWindow = (slices > ENERGY_MAX_SLICES) ? ENERGY_MAX_SLICES : slices;
+    samplesPerSlice = sliceSamples;
+    reset();
+  }
+
+  void reset() {
+    total = 0;
+    next = 0;
+    filled = 0;
+    for (int i = 0;i<ENERGY_MAX_SLICES;i++)
+      sliceSum[i] = 0;
+  }
+
+  // add a new slice, evict the oldest one
+  void addSlice(const int16_t* samples, size_t len) {
+    addEnergy(sumOfSquares(samples, len));
+  }
+
+  // add the sum of squares of a new slice that has been computed already
+  void addEnergy(uint64_t e) {
+    total = total - sliceSum[next] + e;
+    sliceSum[next] = e;
+    next = (next + 1) % slicesPerWindow;
+    if (filled < slicesPerWindow)
+      filled++;
+  }
+
+  // mean square of the window in int16 units
+  uint32_t meanSquare() const {
+    if (filled == 0)
+      return 0;
+    return (uint32_t)(total / ((uint64_t)filled * samplesPerSlice));
+  }
+
+  bool isBelow(uint32_t meanSquareThreshold) const {
+    return meanSquare() < meanSquareThreshold;
+  }
+
+  // RMS normalised to [0..1], for printing only
+  float rms() const {
+    return sqrtf((float)meanSquare()) / 32768.0f;
+  }
+};
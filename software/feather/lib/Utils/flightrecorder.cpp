@@ -0,0 +1,179 @@
+#include <Arduino.h>
+#include <new>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "flightrecorder.h"
+#include "ringbuffer.h"
+#include "inference.h"
+#include "network.h"
+#include "recording.h"
+#include "soundtools.h"
+
+typedef RingBuffer<int16_t, FLIGHT_AUDIO_SIZE> FlightAudioRing;
+typedef RingBuffer<FlightSlice, FLIGHT_SLICES> FlightSliceRing;
+
+// both rings live in one PSRAM block
+struct FlightRings {
+  FlightAudioRing audio;
+  FlightSliceRing slices;
+};
+
+FlightRecorderStats flightStats;
+
+static FlightRings* rings = NULL;               // NULL without PSRAM, the recorder is off then
+static std::atomic<bool> pending(false);        // a snapshot waits for its upload
+static FlightTrigger snapshotTrigger;
+static uint32_t snapshotStart = 0;              // audio ring positions of the snapshot
+static uint32_t snapshotEnd = 0;
+
+static const char* triggerNames[] = { "page_down", "page_up", "manual" };
+static const uint16_t uploadTaskCore = 1;
+static const uint16_t uploadTaskPriority = 1;
+
+void flightRecordAudio(const int16_t* samples, size_t len) {
+  if (rings != NULL)
+    rings->audio.write(samples, len);
+}
+
+void flightRecordSlice(const float* confidence, PageTurnType turn) {
+  if (rings == NULL)
+    return;
+  FlightSlice slice;
+  slice.audioPos = rings->audio.written();
+  slice.timeMs = millis();
+  memcpy(slice.confidence, confidence, sizeof(slice.confidence));
+  slice.agcGain = agcConfig.enabled ? audioGain.gain : AGC_UNITY;
+  slice.turn = turn;
+  rings->slices.write(&slice, 1);
+}
+
+void freezeFlightSnapshot(FlightTrigger trigger) {
+  if (rings == NULL)
+    return;
+  uint32_t t0 = micros();
+  if (pending.load()) {
+    flightStats.skipped++;
+    return;
+  }
+  uint32_t now = rings->audio.written();
+  snapshotTrigger = trigger;
+  snapshotStart = now - FLIGHT_PRE_MS * (SAMPLE_RATE / 1000);
+  snapshotEnd = now + FLIGHT_POST_MS * (SAMPLE_RATE / 1000);
+  pending.store(true);
+  flightStats.snapshots++;
+  flightStats.freeze.add(micros() - t0);
+}
+
+bool isFlightUploading() {
+  return pending.load();
+}
+
+// audio of the snapshot, directly out of the ring
+static bool uploadAudio() {
+  char query[32];
+  snprintf(query, sizeof(query), "?trigger=%s", triggerNames[snapshotTrigger]);
+  if (!beginAudioUpload(query))
+    return false;
+
+  const FlightAudioRing& ring = rings->audio;
+  uint32_t pos = snapshotStart;
+  while (pos != snapshotEnd) {
+    if (!ring.isValid(pos, 1)) {
+      // lapped by the capture task, skip what is gone
+      uint32_t resumePos = ring.written() - FLIGHT_AUDIO_SIZE + RECORDING_CHUNK;
+      if ((int32_t)(resumePos - snapshotEnd) >= 0)
+        resumePos = snapshotEnd;
+      flightStats.lostSamples += resumePos - pos;
+      pos = resumePos;
+      continue;
+    }
+    size_t len = min((uint32_t)RECORDING_CHUNK, snapshotEnd - pos);
+    const int16_t *part1, *part2;
+    size_t len1, len2;
+    ring.view(pos, len, part1, len1, part2, len2);
+    if (!writeUploadAudio(part1, len1) || !writeUploadAudio(part2, len2))
+      return false;
+    pos += len;
+  }
+  return endAudioUpload();
+}
+
+// probabilities of the slices within the snapshot as CSV, one line per slice
+static bool uploadProbabilities() {
+  char path[96];
+  audioUploadPath(path, sizeof(path));
+  strncat(path, "/probabilities", sizeof(path) - strlen(path) - 1);
+  if (!beginChunkedUpload(path, "text/csv"))
+    return false;
+
+  const FlightSliceRing& slices = rings->slices;
+  uint32_t first = slices.written();
+  FlightSlice slice;
+  while ((first != slices.written() - FLIGHT_SLICES) && slices.read(first - 1, &slice, 1) &&
+         ((int32_t)(slice.audioPos - snapshotStart) > 0))
+    first--;
+
+  char line[32 + MAX_LABELS * 28];            // labels are shorter than 24 characters
+  size_t len = snprintf(line, sizeof(line), "sample,time_ms,turn,agc_gain");
+  for (uint8_t l = 0; l < get_no_of_labels(); l++)
+    len += snprintf(line + len, sizeof(line) - len, ",%s", getLabelName(l));
+  len += snprintf(line + len, sizeof(line) - len, "\n");
+  bool ok = writeUploadChunk((const uint8_t*)line, len);
+
+  for (uint32_t i = first; ok && (i != slices.written()); i++) {
+    if (!slices.read(i, &slice, 1) || ((int32_t)(slice.audioPos - snapshotEnd) > 0))
+      break;
+    len = snprintf(line, sizeof(line), "%d,%u,%u,%.3f", (int)(slice.audioPos - snapshotStart), slice.timeMs, slice.turn,
+                   (float)slice.agcGain / AGC_UNITY);
+    for (uint8_t l = 0; l < get_no_of_labels(); l++)
+      len += snprintf(line + len, sizeof(line) - len, ",%.3f", slice.confidence[l]);
+    len += snprintf(line + len, sizeof(line) - len, "\n");
+    ok = writeUploadChunk((const uint8_t*)line, len);
+  }
+  return endChunkedUpload() && ok;
+}
+
+static void uploadTask(void* param) {
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(50));
+    // wait for the audio after the trigger, and for a take of the recorder, they share the upload connection
+    if (!pending.load() || ((int32_t)(rings->audio.written() - snapshotEnd) < 0) || isUploading())
+      continue;
+
+    uint32_t start = millis();
+    if (uploadAudio() && uploadProbabilities()) {
+      flightStats.uploaded++;
+      println("flight snapshot (%s) uploaded in %ums", triggerNames[snapshotTrigger], millis() - start);
+    } else {
+      flightStats.failed++;
+      println("flight snapshot (%s) upload failed", triggerNames[snapshotTrigger]);
+    }
+    pending.store(false);
+  }
+}
+
+void initFlightRecorder() {
+  if (ESP.getPsramSize() > 0) {
+    void* mem = ps_malloc(sizeof(FlightRings));
+    if (mem != NULL)
+      rings = new (mem) FlightRings();
+  }
+  if (rings == NULL) {
+    println("no PSRAM, flight recorder off");
+    return;
+  }
+  println("flight recorder: %u s of audio, %u slices in PSRAM", FLIGHT_AUDIO_SIZE / SAMPLE_RATE, FLIGHT_SLICES);
+  xTaskCreatePinnedToCore(uploadTask, "flightUpload", 4096, NULL, uploadTaskPriority, NULL, uploadTaskCore);
+}
+
+void printFlightRecorderStats() {
+  if (rings == NULL) {
+    println("flight recorder: off (no PSRAM)");
+    return;
+  }
+  println("flight recorder: %u snapshots, %u skipped, %u uploaded, %u failed, %u samples lost, freeze mean %.1fus max %uus",
+          flightStats.snapshots, flightStats.skipped, flightStats.uploaded, flightStats.failed, flightStats.lostSamples,
+          flightStats.freeze.mean_us(), flightStats.freeze.max_us);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+#include "constants.h"
+#include "pipeline.h"
+
+// Flight recorder: a ring in PSRAM always holds the last seconds of audio as captured (before the
+// automatic gain control, agc.h) and the probability vector and AGC gain of every slice, so what the
+// classifier saw can be reconstructed. A page turn or a tap on the button ("that was wrong")
+// freezes a snapshot by taking the ring positions only, nothing is copied in the live path.
+// Once the audio after the trigger is in, a background task uploads the snapshot straight out of
+// the ring to /api/audio/<device id>?trigger=..., the probabilities as CSV to .../probabilities.
+// One snapshot at a time, triggers while one is pending are counted and skipped.
+
+#define FLIGHT_AUDIO_SIZE (1 << 17)             // [samples] 8s in PSRAM, power of two
+#define FLIGHT_SLICES 128                       // probability vectors, 12.8s of 100ms slices
+#define FLIGHT_PRE_MS 4000                      // audio before the trigger
+#define FLIGHT_POST_MS 1000                     // audio after the trigger
+
+enum FlightTrigger : uint8_t { FLIGHT_PAGE_DOWN, FLIGHT_PAGE_UP, FLIGHT_MANUAL };
+
+// probabilities of one slice and where it ended in the audio ring
+struct FlightSlice {
+  uint32_t audioPos;
+  uint32_t timeMs;
+  float confidence[MAX_LABELS];
+  uint16_t agcGain;                             // [Q12] gain of the AGC at the end of the slice, AGC_UNITY when off
+  uint8_t turn;                                 // PageTurnType
+};
+
+struct FlightRecorderStats {
+  uint32_t snapshots = 0;
+  uint32_t skipped = 0;                         // triggered while a snapshot was pending
+  uint32_t uploaded = 0;
+  uint32_t failed = 0;
+  uint32_t lostSamples = 0;                     // overwritten before the upload got to them
+  StageTime freeze;                             // [us] cost of freezing a snapshot in the live path
+};
+extern FlightRecorderStats flightStats;
+
+void initFlightRecorder();
+bool isFlightUploading();
+
+// called by the capture task for every block of samples
+void flightRecordAudio(const int16_t* samples, size_t len);
+
+// slice observer of the pipeline (setSliceObserver)
+void flightRecordSlice(const float* confidence, PageTurnType turn);
+
+void freezeFlightSnapshot(FlightTrigger trigger);
+void printFlightRecorderStats();
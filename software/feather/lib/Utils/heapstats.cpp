@@ -0,0 +1,105 @@
+#include <Arduino.h>
+#include <atomic>
+#include "heapstats.h"
+#include "constants.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include <esp_heap_caps.h>
+#endif
+
+#ifndef HEAP_TRACE
+#define HEAP_TRACE 0
+#endif
+
+static std::atomic<uint32_t> allocations(0);
+static std::atomic<uint32_t> loopAllocations(0);
+static std::atomic<uint32_t> frees(0);
+static std::atomic<uint32_t> failures(0);
+
+#if HEAP_TRACE && defined(ARDUINO_ARCH_ESP32)
+static TaskHandle_t loopTask = NULL;
+
+static inline void countAllocation(void* ptr) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (ptr == NULL)
+    failures.fetch_add(1, std::memory_order_relaxed);
+  if ((loopTask != NULL) && !xPortInIsrContext() && (xTaskGetCurrentTaskHandle() == loopTask))
+    loopAllocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+// the linker redirects all calls of malloc & co to these (-Wl,--wrap=...)
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nitems, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size) {
+  void* ptr = __real_malloc(size);
+  countAllocation(ptr);
+  return ptr;
+}
+
+void* __wrap_calloc(size_t nitems, size_t size) {
+  void* ptr = __real_calloc(nitems, size);
+  countAllocation(ptr);
+  return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  void* resized = __real_realloc(ptr, size);
+  countAllocation(resized);
+  return resized;
+}
+
+void __wrap_free(void* ptr) {
+  if (ptr != NULL)
+    frees.fetch_add(1, std::memory_order_relaxed);
+  __real_free(ptr);
+}
+}
+
+void traceLoopHeap() {
+  loopTask = xTaskGetCurrentTaskHandle();
+}
+#else
+void traceLoopHeap() {
+}
+#endif
+
+uint32_t heapAllocations() {
+  return allocations.load(std::memory_order_relaxed);
+}
+
+uint32_t loopHeapAllocations() {
+  return loopAllocations.load(std::memory_order_relaxed);
+}
+
+bool heapTraceEnabled() {
+  return HEAP_TRACE;
+}
+
+#ifdef ARDUINO_ARCH_ESP32
+static void printHeapRegion(const char* name, uint32_t caps) {
+  size_t total = heap_caps_get_total_size(caps);
+  if (total == 0)
+    return;
+  size_t freeBytes = heap_caps_get_free_size(caps);
+  size_t largest = heap_caps_get_largest_free_block(caps);
+  size_t lowest = heap_caps_get_minimum_free_size(caps);
+  println("   %-8s %7u of %7u bytes free, largest block %7u (%u%% fragmented), lowest %7u (high-water %u bytes used)",
+          name, freeBytes, total, largest, (freeBytes > 0) ? (uint32_t)(100 - largest * 100 / freeBytes) : 0, lowest, total - lowest);
+}
+#endif
+
+void printHeapStats() {
+#ifdef ARDUINO_ARCH_ESP32
+  println("heap:");
+  printHeapRegion("internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  printHeapRegion("PSRAM", MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+  println("heap: not measured on the host");
+#endif
+  if (heapTraceEnabled())
+    println("   %u allocations (%u in the loop task), %u frees, %u failed", heapAllocations(), loopHeapAllocations(),
+            frees.load(std::memory_order_relaxed), failures.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Heap diagnostics. In the steady state (audio, inference, BLE, heartbeat) nothing is allocated,
+// buffers are static and the classifier has its private heap. The debug build (env heaptrace,
+// -D HEAP_TRACE=1 and -Wl,--wrap=malloc,...) counts every malloc/calloc/realloc of the firmware,
+// heap_caps_malloc is not counted. Without it the counters stay 0.
+
+// allocations since boot, of all tasks and of the loop task only (the scheduler attributes them to its tasks)
+uint32_t heapAllocations();
+uint32_t loopHeapAllocations();
+bool heapTraceEnabled();
+
+// call from setup(), it runs in the loop task
+void traceLoopHeap();
+
+// free heap, largest free block (fragmentation), lowest free heap since boot (high-water mark)
+void printHeapStats();
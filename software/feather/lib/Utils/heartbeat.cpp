@@ -0,0 +1,89 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_heap_caps.h>
+
+#include "heartbeat.h"
+#include "streaming.h"
+#include "network.h"
+#include "inference.h"
+#include "soundtools.h"
+#include "bleturn.h"
+#include "battery.h"
+#include "boot.h"
+#include "EEPROMStorage.h"
+
+// load per core from the run time of its idle task since the last call
+static void measureCpuLoad(uint8_t load[2]) {
+  load[0] = load[1] = HEARTBEAT_CPU_UNKNOWN;
+#if (configGENERATE_RUN_TIME_STATS == 1) && (configUSE_TRACE_FACILITY == 1)
+  static uint32_t lastIdle[portNUM_PROCESSORS];
+  static uint32_t lastTotal = 0;
+  uint32_t total = portGET_RUN_TIME_COUNTER_VALUE();
+  uint32_t elapsed = total - lastTotal;
+  for (int core = 0; (core < portNUM_PROCESSORS) && (core < 2); core++) {
+    TaskStatus_t status;
+    vTaskGetInfo(xTaskGetIdleTaskHandleForCPU(core), &status, pdFALSE, eRunning);
+    uint32_t idle = status.ulRunTimeCounter - lastIdle[core];
+    lastIdle[core] = status.ulRunTimeCounter;
+    if ((lastTotal != 0) && (elapsed > 0))
+      load[core] = (idle >= elapsed) ? 0 : (uint8_t)(100 - (uint64_t)idle * 100 / elapsed);
+  }
+  lastTotal = total;
+#endif
+}
+
+void fillHeartbeat(HeartbeatFrame& frame) {
+  memset(&frame, 0, sizeof(frame));
+  frame.version = HEARTBEAT_VERSION;
+  frame.labelCount = min((int)get_no_of_labels(), MAX_LABELS);
+  measureCpuLoad(frame.cpuLoad);
+  frame.uptimeMs = millis();
+
+  frame.firmwareVersion = VERSION;
+  frame.cpuMHz = ESP.getCpuFreqMHz();
+  frame.flashBytes = ESP.getFlashChipSize();
+  frame.psramBytes = ESP.getPsramSize();
+  strncpy(frame.chip, ESP.getChipModel(), sizeof(frame.chip) - 1);
+  strncpy(frame.owner, config.model.owner, sizeof(frame.owner) - 1);
+  frame.connectMs = networkStats.connectMs;
+  frame.firstInferenceMs = bootStats.firstInferenceMs;
+
+  frame.freeHeap = ESP.getFreeHeap();
+  frame.minFreeHeap = ESP.getMinFreeHeap();
+  frame.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+
+  frame.capturedSamples = captureStats.capturedSamples;
+  frame.droppedSamples = captureStats.droppedSamples;
+  frame.overrunSamples = captureStats.overrunSamples;
+
+  memcpy(frame.inferenceLatency, pipelineCounters.inferenceLatency.counts, sizeof(frame.inferenceLatency));
+  frame.inferenceMaxUs = pipelineTiming.inference.max_us;
+
+  frame.rssi = (WiFi.status() == WL_CONNECTED) ? WiFi.RSSI() : 0;
+  frame.bleConnected = bleStats.connected;
+  frame.bleInterval = bleStats.connInterval;
+  frame.bleNotifyMeanUs = bleStats.decisionToNotify.mean_us();
+  frame.bleNotifyMaxUs = bleStats.decisionToNotify.max_us;
+  frame.bleCompleteMeanUs = bleStats.decisionToComplete.mean_us();
+  frame.bleCompleteMaxUs = bleStats.decisionToComplete.max_us;
+
+  float voltage, percentage;
+  lastBatReading(voltage, percentage);
+  frame.batteryMv = voltage * 1000;
+  frame.batteryPercent = constrain(percentage, 0, 100);
+
+  memcpy(frame.sliceWinners, pipelineCounters.sliceWinners, sizeof(frame.sliceWinners));
+  memcpy(frame.labelTurns, pipelineCounters.labelTurns, sizeof(frame.labelTurns));
+
+  frame.agcGain = min(audioGain.gain, (int32_t)UINT16_MAX);
+  frame.agcEnvelope = audioGain.envelope;
+  frame.agcBlocks = audioGain.blocks;
+  frame.agcGatedBlocks = audioGain.gatedBlocks;
+  frame.agcClippedSamples = audioGain.clippedSamples;
+}
+
+bool sendHeartbeat() {
+  HeartbeatFrame frame;
+  fillHeartbeat(frame);
+  return sendStreamFrame(STREAM_FRAME_HEARTBEAT, 0, 0, (const uint8_t*)&frame, sizeof(frame), 0);
+}
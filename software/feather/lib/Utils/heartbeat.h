@@ -0,0 +1,73 @@
+#pragma once
+
+#include <Arduino.h>
+#include "constants.h"
+#include "pipeline.h"
+
+// Periodic heartbeat with the runtime performance of the device, sent as a STREAM_FRAME_HEARTBEAT
+// over the persistent stream connection (streaming.h). The backend decodes it with webserver/heartbeat.py
+// and pushes the changed fields to the dashboard. Counters run since boot, the backend builds the deltas.
+// A new field goes to the end and increments HEARTBEAT_VERSION.
+
+#define HEARTBEAT_VERSION 2
+#define HEARTBEAT_CPU_UNKNOWN 255           // FreeRTOS built without run time statistics
+
+// all fields little endian
+struct __attribute__((packed)) HeartbeatFrame {
+  uint8_t  version;                         // HEARTBEAT_VERSION
+  uint8_t  labelCount;
+  uint8_t  cpuLoad[2];                      // [%] per core since the last heartbeat
+  uint32_t uptimeMs;
+
+  // device
+  uint16_t firmwareVersion;
+  uint16_t cpuMHz;
+  uint32_t flashBytes;
+  uint32_t psramBytes;
+  char     chip[16];
+  char     owner[WIFI_CREDENTIAL_LEN];
+  uint32_t connectMs;                       // boot until WiFi is up
+  uint32_t firstInferenceMs;                // boot until the first classified slice
+
+  // memory
+  uint32_t freeHeap;
+  uint32_t minFreeHeap;                     // lowest since boot
+  uint32_t largestFreeBlock;
+
+  // audio capture
+  uint32_t capturedSamples;
+  uint32_t droppedSamples;                  // DMA overflow
+  uint32_t overrunSamples;                  // ring overrun
+
+  // classifier
+  uint32_t inferenceLatency[LATENCY_BUCKETS];
+  uint32_t inferenceMaxUs;
+
+  // radio
+  int8_t   rssi;                            // [dBm]
+  uint8_t  bleConnected;
+  uint16_t bleInterval;                     // [1.25ms]
+  uint32_t bleNotifyMeanUs;                 // decision until the key reports are handed to the stack
+  uint32_t bleNotifyMaxUs;
+  uint32_t bleCompleteMeanUs;               // decision until the stack confirmed the key press
+  uint32_t bleCompleteMaxUs;
+
+  // battery
+  uint16_t batteryMv;
+  uint8_t  batteryPercent;
+  uint8_t  reserved;
+
+  // decisions
+  uint32_t sliceWinners[MAX_LABELS];
+  uint32_t labelTurns[MAX_LABELS];
+
+  // automatic gain control (version 2)
+  uint16_t agcGain;                         // [Q12] current gain
+  uint16_t agcEnvelope;                     // speech-band level of the input
+  uint32_t agcBlocks;
+  uint32_t agcGatedBlocks;                  // below the noise gate
+  uint32_t agcClippedSamples;
+};
+
+void fillHeartbeat(HeartbeatFrame& frame);
+bool sendHeartbeat();
@@ -1,6 +1,141 @@
 #include <Arduino.h>
 #include "inference.h"
+#include "energy.h"
+#include "constants.h"
+#include "log.h"
 #include "PageTurner_inferencing.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include <esp_heap_caps.h>
+#if __has_include(<esp_memory_utils.h>)
+#include <esp_memory_utils.h>
+#else
+#include <soc/soc_memory_layout.h>
+#endif
+#endif
+
+// Kernels: on ESP32 targets the int8 convolution and fully connected kernels of ESP-NN are used
+// (the S3 variants are picked by the SDK from the target). Everything else falls back to the reference kernels.
+#if defined(ARDUINO_ARCH_ESP32) && (!defined(EI_CLASSIFIER_TFLITE_ENABLE_ESP_NN) || (EI_CLASSIFIER_TFLITE_ENABLE_ESP_NN == 0))
+#warning "ESP-NN disabled, the classifier runs on the slow reference kernels (set -D EI_CLASSIFIER_TFLITE_ENABLE_ESP_NN=1)"
+#define INFERENCE_SLOW_KERNELS "ESP-NN disabled"
+#endif
+#if defined(EI_CLASSIFIER_TFLITE_INPUT_DATATYPE) && defined(EI_CLASSIFIER_DATATYPE_INT8) && (EI_CLASSIFIER_TFLITE_INPUT_DATATYPE != EI_CLASSIFIER_DATATYPE_INT8)
+#warning "the model is not int8 quantized, ESP-NN does not accelerate float models"
+#undef INFERENCE_SLOW_KERNELS
+#define INFERENCE_SLOW_KERNELS "float model"
+#endif
+
+// Tensor arena and all other allocations of the SDK. The SDK allocates its feature matrices
+// and scratch buffers anew for every slice, so they are served from a private heap that is
+// carved out once at startup and never touches the system heap again. Internal RAM is faster,
+// PSRAM (-D EI_ARENA_IN_PSRAM=1) leaves the internal RAM to WiFi and BLE. If the preferred
+// region is exhausted, the other one is used. Allocations that do not fit into the private heap
+// go to the system heap and are counted as fallbacks.
+#ifndef EI_ARENA_IN_PSRAM
+#define EI_ARENA_IN_PSRAM 0
+#endif
+
+// tensor arena plus the DSP buffers of a slice
+#ifndef INFERENCE_HEAP_SIZE
+#ifdef EI_CLASSIFIER_TFLITE_LARGEST_ARENA_SIZE
+#define INFERENCE_HEAP_SIZE (EI_CLASSIFIER_TFLITE_LARGEST_ARENA_SIZE + 48 * 1024)
+#else
+#define INFERENCE_HEAP_SIZE (48 * 1024)
+#endif
+#endif
+
+ArenaStats inferenceArena;
+
+#ifdef ARDUINO_ARCH_ESP32
+#include <multi_heap.h>
+
+static multi_heap_handle_t inferenceHeap = NULL;
+static uint8_t* inferenceHeapStart = NULL;
+static bool inferenceHeapTried = false;
+
+static void initInferenceHeap() {
+  inferenceHeapTried = true;
+  const uint32_t internal = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+  const uint32_t psram = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+  inferenceHeapStart = (uint8_t*)heap_caps_malloc(INFERENCE_HEAP_SIZE, EI_ARENA_IN_PSRAM ? psram : internal);
+  if (inferenceHeapStart == NULL)
+    inferenceHeapStart = (uint8_t*)heap_caps_malloc(INFERENCE_HEAP_SIZE, EI_ARENA_IN_PSRAM ? internal : psram);
+  if (inferenceHeapStart != NULL)
+    inferenceHeap = multi_heap_register(inferenceHeapStart, INFERENCE_HEAP_SIZE);
+  if (inferenceHeap == NULL)
+    println("no private heap for the classifier, it allocates from the system heap");
+}
+
+static bool inInferenceHeap(void* ptr) {
+  return (inferenceHeap != NULL) && ((uint8_t*)ptr >= inferenceHeapStart) && ((uint8_t*)ptr < inferenceHeapStart + INFERENCE_HEAP_SIZE);
+}
+
+static size_t allocatedSize(void* ptr) {
+  return inInferenceHeap(ptr) ? multi_heap_get_allocated_size(inferenceHeap, ptr) : heap_caps_get_allocated_size(ptr);
+}
+
+static void* arenaAlloc(size_t size) {
+  if (!inferenceHeapTried)
+    initInferenceHeap();
+  void* ptr = (inferenceHeap != NULL) ? multi_heap_malloc(inferenceHeap, size) : NULL;
+  bool fallback = (ptr == NULL);
+  if (fallback)
+    ptr = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+  if (ptr != NULL) {
+    size_t allocated = allocatedSize(ptr);
+    inferenceArena.bytes += allocated;
+    if (inferenceArena.bytes > inferenceArena.peakBytes)
+      inferenceArena.peakBytes = inferenceArena.bytes;
+    if (esp_ptr_external_ram(ptr))
+      inferenceArena.psramBytes += allocated;
+    if (fallback)
+      inferenceArena.fallbacks++;
+  }
+  return ptr;
+}
+
+void *ei_malloc(size_t size) {
+  return arenaAlloc(size);
+}
+
+void *ei_calloc(size_t nitems, size_t size) {
+  void* ptr = arenaAlloc(nitems * size);
+  if (ptr != NULL)
+    memset(ptr, 0, nitems * size);
+  return ptr;
+}
+
+void ei_free(void *ptr) {
+  if (ptr == NULL)
+    return;
+  size_t allocated = allocatedSize(ptr);
+  inferenceArena.bytes -= allocated;
+  if (esp_ptr_external_ram(ptr))
+    inferenceArena.psramBytes -= allocated;
+  if (inInferenceHeap(ptr))
+    multi_heap_free(inferenceHeap, ptr);
+  else
+    heap_caps_free(ptr);
+}
+#endif
+
+// Model weights and labels out of a flash partition instead of the compiled-in model (-D MODEL_FROM_PARTITION=1).
+// The firmware still provides the DSP block, the container has to match its parameters.
+#if MODEL_FROM_PARTITION
+#include "modelstore.h"
+#if EI_CLASSIFIER_INFERENCING_ENGINE != EI_CLASSIFIER_TFLITE
+#error "MODEL_FROM_PARTITION needs the TFLite interpreter, deploy the model without EON compiler"
+#endif
+
+// copy of the compiled-in impulse, pointing to the mapped weights
+static ei_impulse_t partitionImpulse;
+static ei_learning_block_t partitionBlock;
+static ei_learning_block_config_tflite_graph_t partitionBlockConfig;
+static ei_config_tflite_graph_t partitionGraph;
+static const char* partitionCategories[EI_CLASSIFIER_LABEL_COUNT];
+static ei_impulse_handle_t partitionHandle(&partitionImpulse);
+#endif
+static ei_impulse_handle_t* impulseHandle = &ei_default_impulse;
 
 // Label indices for special commands
 uint16_t silence_label_no = EI_CLASSIFIER_LABEL_COUNT;
@@ -11,13 +146,17 @@ uint16_t back_label_no    = EI_CLASSIFIER_LABEL_COUNT;
 
 // Initialize indices of command labels
 void initSpecialLabels() {
-  String targets[] = { "silence", "weiter", "next", "zurück", "back" };
+  const char* targets[] = { "silence", "weiter", "next", "zurück", "back" };
   uint16_t* results[] = { &silence_label_no, &weiter_label_no, &next_label_no, &zurueck_label_no, &back_label_no };
 
+  for (size_t j = 0; j < sizeof(targets) / sizeof(targets[0]); j++)
+    *results[j] = EI_CLASSIFIER_LABEL_COUNT;
+
+  // the label table of the impulse in use, compiled in or loaded from the model partition
   for (int i = 0; i < EI_CLASSIFIER_LABEL_COUNT; i++) {
-    String label = ei_classifier_inferencing_categories[i];
+    const char* label = impulseHandle->impulse->categories[i];
     for (size_t j = 0; j < sizeof(targets) / sizeof(targets[0]); j++) {
-      if (label == targets[j]) {
+      if (strcmp(label, targets[j]) == 0) {
         *results[j] = i;
       }
     }
@@ -25,15 +164,12 @@ void initSpecialLabels() {
 }
 
 
-// Compute RMS of a sample buffer
+// Compute RMS of a sample buffer, normalised to [0..1]
 float computeRMS(const int16_t* samples, size_t len) {
-  uint64_t acc = 0;
-  for (size_t i = 0; i < len; ++i) {
-    float y = samples[i] / 32768.0f;   // normalize to [-1..1]
-    acc += uint64_t(y * y * 1e9f);     // scale for integer accumulator
-  }
-  float mean = float(acc) / float(len) / 1e9f;
-  return mean;
+  if (len == 0)
+    return 0;
+  float meanSquare = (float)sumOfSquares(samples, len) / (float)len;
+  return sqrtf(meanSquare) / 32768.0f;
 }
 
 // Check if buffer is below silence threshold
@@ -52,11 +188,34 @@ uint8_t get_no_of_labels() {
   return EI_CLASSIFIER_LABEL_COUNT;
 }
 
-String getLabelName(uint8_t no) {
-  return  ei_classifier_inferencing_categories[no];
+const char* getLabelName(uint8_t no) {
+  return impulseHandle->impulse->categories[no];
 }
 
 
+InferenceTiming lastInferenceTiming = { 0, 0 };
+
+// Pick the highest scoring label and hand out the full probability vector
+static void evaluateResult(const ei_impulse_result_t &result, float confidence[], int &pred_no) {
+  lastInferenceTiming.dsp_us = result.timing.dsp_us;
+  lastInferenceTiming.classification_us = result.timing.classification_us;
+
+  float score = 0;
+  pred_no = -1;
+  for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) {
+    confidence[ix] = result.classification[ix].value;
+    if (score < result.classification[ix].value) {
+      pred_no = ix;
+      score = result.classification[ix].value;
+    }
+  }
+
+  // Optionally print anomaly score
+#if EI_CLASSIFIER_HAS_ANOMALY == 1
+  ei_printf("    anomaly score: %.3f\n", result.anomaly);
+#endif
+}
+
 // Run model inference on audio buffer
 void runInference(int16_t buffer[], size_t samples, float confidence[], int &pred_no) {
   // Prepare signal for classifier
@@ -67,30 +226,145 @@ void runInference(int16_t buffer[], size_t samples, float confidence[], int &pre
 
   // Execute classifier
   ei_impulse_result_t result;
-  EI_IMPULSE_ERROR r = run_classifier(&signal, &result, false);
+  EI_IMPULSE_ERROR r = run_classifier(impulseHandle, &signal, &result, false);
   if (r != EI_IMPULSE_OK) {
     ei_printf("ERR: Failed to run classifier (%d)\n", r);
+    pred_no = -1;
     return;
   }
 
-  // Determine highest scoring label
-  float score = 0;
-  pred_no = -1;
-  for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) {
-    if (score < result.classification[ix].value) {
-      pred_no = ix;
-      score = result.classification[ix].value;
-      confidence[ix] = score; 
-    }
+  evaluateResult(result, confidence, pred_no);
+}
+
+// number of samples that make up one slice of continuous inference
+size_t get_slice_size() {
+  return EI_CLASSIFIER_SLICE_SIZE;
+}
+
+// Start continuous inference from scratch (clears the cached feature frames)
+void resetContinuousInference() {
+  run_classifier_init(impulseHandle);
+}
+
+// Continuous inference: featurizes only the new slice of get_slice_size() samples, 
+// the features of the previous slices are cached by the SDK and the classifier runs on the rolling feature matrix
+void runInferenceSlice(int16_t slice[], float confidence[], int &pred_no) {
+  get_data_buffer_ptr = slice;
+  signal_t signal;
+  signal.total_length = EI_CLASSIFIER_SLICE_SIZE;
+  signal.get_data = &get_data;
+
+  ei_impulse_result_t result;
+  EI_IMPULSE_ERROR r = run_classifier_continuous(impulseHandle, &signal, &result, false, true);
+  if (r != EI_IMPULSE_OK) {
+    ei_printf("ERR: Failed to run continuous classifier (%d)\n", r);
+    pred_no = -1;
+    return;
   }
 
-  // Optionally print anomaly score
-#if EI_CLASSIFIER_HAS_ANOMALY == 1
-  ei_printf("    anomaly score: %.3f\n", result.anomaly);
-#endif
+  evaluateResult(result, confidence, pred_no);
+}
+
+
+#if MODEL_FROM_PARTITION
+// The network of a partition has to have the same input and output shape as the compiled-in one,
+// since the DSP block and result arrays are compiled in.
+static bool matchesFirmware(const ModelContainerHeader* h, const char* partitionLabel) {
+  const ei_impulse_t* base = ei_default_impulse.impulse;
+  if ((h->frequency != (uint32_t)base->frequency) || (h->rawSampleCount != base->raw_sample_count) ||
+      (h->inputFrameSize != base->nn_input_frame_size) || (h->labelCount != EI_CLASSIFIER_LABEL_COUNT) ||
+      (base->learning_blocks_size != 1)) {
+    println("model in %s does not match the DSP block of the firmware, keeping the current model", partitionLabel);
+    return false;
+  }
+  return true;
+}
+
+bool checkModelPartition(const char* partitionLabel) {
+  LoadedModel candidate;
+  if (!mapModelPartition(partitionLabel, candidate))
+    return false;
+  bool ok = matchesFirmware(candidate.header, partitionLabel);
+  unmapModelPartition(candidate);
+  return ok;
+}
+
+// Switch the impulse to the weights and labels of a model partition. The partition is verified
+// completely before the switch, if it fails the current model keeps running.
+bool selectModelPartition(const char* partitionLabel) {
+  LoadedModel candidate;
+  if (!mapModelPartition(partitionLabel, candidate))
+    return false;
+  if (!matchesFirmware(candidate.header, partitionLabel)) {
+    unmapModelPartition(candidate);
+    return false;
+  }
+  useModelPartition(candidate);
+
+  const ModelContainerHeader* h = loadedModel.header;
+  const ei_impulse_t* base = ei_default_impulse.impulse;
+
+  partitionImpulse = *base;
+  partitionBlock = base->learning_blocks[0];
+  partitionBlockConfig = *(const ei_learning_block_config_tflite_graph_t*)partitionBlock.config;
+  partitionGraph = *(const ei_config_tflite_graph_t*)partitionBlockConfig.graph_config;
+  partitionGraph.model = loadedModel.weights;
+  partitionGraph.model_size = h->modelBytes;
+  partitionGraph.arena_size = h->arenaSize;
+  partitionBlockConfig.graph_config = &partitionGraph;
+  partitionBlock.config = &partitionBlockConfig;
+  partitionImpulse.learning_blocks = &partitionBlock;
+  for (uint8_t i = 0;i<EI_CLASSIFIER_LABEL_COUNT;i++)
+    partitionCategories[i] = h->labels[i];
+  partitionImpulse.categories = partitionCategories;
+
+  impulseHandle = &partitionHandle;
+  initSpecialLabels();
+  run_classifier_init(impulseHandle);
+  printLoadedModel();
+  return true;
+}
+#else
+bool selectModelPartition(const char* partitionLabel) {
+  println("firmware is built with the compiled-in model (MODEL_FROM_PARTITION=0)");
+  return false;
 }
 
+bool checkModelPartition(const char* partitionLabel) {
+  return false;
+}
+#endif
 
 void setupInference() {
+#ifdef INFERENCE_SLOW_KERNELS
+  logWarn("classifier uses slow reference kernels (%s)", INFERENCE_SLOW_KERNELS);
+#endif
+#if MODEL_FROM_PARTITION
+  if (selectModelPartition("model0"))
+    return;
+#endif
   initSpecialLabels();
+  run_classifier_init(impulseHandle);
+}
+
+// model version, kernels and memory of the classifier
+void printInferenceInfo() {
+  println("model \"%s\" project %u, deploy version %u, %u labels, slice %u samples",
+          EI_CLASSIFIER_PROJECT_NAME, (uint32_t)EI_CLASSIFIER_PROJECT_ID, (uint32_t)EI_CLASSIFIER_PROJECT_DEPLOY_VERSION,
+          EI_CLASSIFIER_LABEL_COUNT, EI_CLASSIFIER_SLICE_SIZE);
+#if MODEL_FROM_PARTITION
+  printLoadedModel();
+#endif
+#ifdef INFERENCE_SLOW_KERNELS
+  println("   kernels: reference (%s)", INFERENCE_SLOW_KERNELS);
+#elif defined(CONFIG_IDF_TARGET_ESP32S3)
+  println("   kernels: ESP-NN (ESP32-S3)");
+#elif defined(ARDUINO_ARCH_ESP32)
+  println("   kernels: ESP-NN (ESP32)");
+#else
+  println("   kernels: reference (host)");
+#endif
+  println("   arena: %u bytes in use, peak %u bytes of a private heap of %u bytes, %u bytes in PSRAM, %u fallbacks, preferred %s",
+          inferenceArena.bytes, inferenceArena.peakBytes, INFERENCE_HEAP_SIZE, inferenceArena.psramBytes, inferenceArena.fallbacks,
+          EI_ARENA_IN_PSRAM ? "PSRAM" : "internal RAM");
 }
\ No newline at end of file
@@ -2,6 +2,11 @@
 
 #include <Arduino.h>
 
+// model weights and labels out of a flash partition instead of the compiled-in model, see platformio.ini
+#ifndef MODEL_FROM_PARTITION
+#define MODEL_FROM_PARTITION 0
+#endif
+
 // Label indices for special commands
 extern uint16_t silence_label_no;
 extern uint16_t weiter_label_no;
@@ -9,10 +14,32 @@ extern uint16_t next_label_no ;
 extern uint16_t zurueck_label_no;
 extern uint16_t back_label_no ;
 
+// split of the last inference as measured by the SDK
+struct InferenceTiming {
+  uint32_t dsp_us;
+  uint32_t classification_us;
+};
+extern InferenceTiming lastInferenceTiming;
+
+// memory of the classifier (tensor arena and SDK buffers), tracked by the allocator of the SDK
+struct ArenaStats {
+  uint32_t bytes = 0;                 // currently allocated
+  uint32_t peakBytes = 0;
+  uint32_t psramBytes = 0;            // part of bytes that lives in PSRAM
+  uint32_t fallbacks = 0;             // allocations that did not fit into the private heap
+};
+extern ArenaStats inferenceArena;
+
 // Initialize indices of command labels
 
 float computeRMS(const int16_t* samples, size_t len) ;
 void runInference(int16_t buffer[], size_t samples, float confidence[], int &pred_no);
+void runInferenceSlice(int16_t slice[], float confidence[], int &pred_no);
+void resetContinuousInference();
+size_t get_slice_size();
 uint8_t get_no_of_labels();
 void setupInference();
-String getLabelName(uint8_t no);
+bool selectModelPartition(const char* partitionLabel);
+bool checkModelPartition(const char* partitionLabel);      // verifies it against the firmware without switching
+void printInferenceInfo();
+const char* getLabelName(uint8_t no);
@@ -0,0 +1,161 @@
+#include <Arduino.h>
+#include <atomic>
+#include "log.h"
+#include "constants.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#endif
+
+LogStats logStats;
+uint8_t logLevel = LOG_INFO;
+
+static_assert((LOG_RING_LINES & (LOG_RING_LINES - 1)) == 0, "LOG_RING_LINES must be a power of two");
+
+// bounded multi-producer/single-consumer ring: every slot carries a sequence number that tells
+// whether it is free for the producer at position pos (seq == pos) or ready for the consumer (seq == pos + 1)
+struct LogSlot {
+  std::atomic<uint32_t> seq;
+  const char* text;                         // either a literal or line
+  bool newline;
+  char line[LOG_LINE_LEN];
+};
+
+static LogSlot ring[LOG_RING_LINES];
+static std::atomic<uint32_t> tail(0);       // next position for the producers
+static uint32_t head = 0;                   // next position of the consumer (flush task)
+static bool asyncLog = false;
+
+#ifdef ARDUINO_ARCH_ESP32
+// single consumer: the log task and flushLog() take turns on head
+static SemaphoreHandle_t consumerMutex = NULL;
+static StaticSemaphore_t consumerMutexBuffer;
+#endif
+
+static const char* levelPrefix[] = { "ERROR: ", "WARNING: ", "", "" };
+
+size_t logQueueDepth() {
+  return tail.load(std::memory_order_relaxed) - head;
+}
+
+// take one line out of the ring, false if there is none ready
+static bool writeNextLine() {
+  LogSlot& slot = ring[head & (LOG_RING_LINES - 1)];
+  if (slot.seq.load(std::memory_order_acquire) != head + 1)
+    return false;
+  Serial.print(slot.text);
+  if (slot.newline)
+    Serial.println();
+  slot.seq.store(head + LOG_RING_LINES, std::memory_order_release);
+  head++;
+  return true;
+}
+
+void flushLog() {
+#ifdef ARDUINO_ARCH_ESP32
+  if (consumerMutex != NULL)
+    xSemaphoreTake(consumerMutex, portMAX_DELAY);
+#endif
+  while (writeNextLine())
+    ;
+  Serial.flush();
+#ifdef ARDUINO_ARCH_ESP32
+  if (consumerMutex != NULL)
+    xSemaphoreGive(consumerMutex);
+#endif
+}
+
+#ifdef ARDUINO_ARCH_ESP32
+static void logTask(void* param) {
+  while (true) {
+    xSemaphoreTake(consumerMutex, portMAX_DELAY);
+    bool written = writeNextLine();
+    xSemaphoreGive(consumerMutex);
+    if (!written)
+      vTaskDelay(pdMS_TO_TICKS(5));
+  }
+}
+#endif
+
+void initLog() {
+  for (uint32_t i = 0; i < LOG_RING_LINES; i++)
+    ring[i].seq.store(i, std::memory_order_relaxed);
+#ifdef ARDUINO_ARCH_ESP32
+  consumerMutex = xSemaphoreCreateMutexStatic(&consumerMutexBuffer);
+  asyncLog = true;
+  xTaskCreatePinnedToCore(logTask, "log", 2048, NULL, LOG_TASK_PRIORITY, NULL, LOG_TASK_CORE);
+#endif
+}
+
+void logMessage(LogLevel level, bool newline, const char* format, va_list args) {
+  if (level > logLevel)
+    return;
+
+  if (!asyncLog) {
+    char s[256];
+    vsnprintf(s, sizeof(s), format, args);
+    Serial.print(levelPrefix[level]);
+    Serial.print(s);
+    if (newline)
+      Serial.println();
+    return;
+  }
+
+  // reserve a slot, never wait for the flush task
+  uint32_t pos = tail.load(std::memory_order_relaxed);
+  LogSlot* slot;
+  while (true) {
+    slot = &ring[pos & (LOG_RING_LINES - 1)];
+    int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      __atomic_add_fetch(&logStats.dropped, 1, __ATOMIC_RELAXED);
+      return;
+    } else
+      pos = tail.load(std::memory_order_relaxed);
+  }
+
+  // plain text is queued by pointer, everything else formatted right into the slot
+  if ((level == LOG_INFO || level == LOG_DEBUG) && (strchr(format, '%') == NULL)) {
+    slot->text = format;
+  } else {
+    int len = snprintf(slot->line, sizeof(slot->line), "%s", levelPrefix[level]);
+    vsnprintf(slot->line + len, sizeof(slot->line) - len, format, args);
+    slot->text = slot->line;
+  }
+  slot->newline = newline;
+  slot->seq.store(pos + 1, std::memory_order_release);
+
+  __atomic_add_fetch(&logStats.lines, 1, __ATOMIC_RELAXED);
+  uint32_t depth = pos + 1 - head;
+  if (depth > logStats.maxDepth)
+    logStats.maxDepth = depth;
+}
+
+void logError(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  logMessage(LOG_ERROR, true, format, args);
+  va_end(args);
+}
+
+void logWarn(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  logMessage(LOG_WARN, true, format, args);
+  va_end(args);
+}
+
+void logDebug(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  logMessage(LOG_DEBUG, true, format, args);
+  va_end(args);
+}
+
+void printLogStats() {
+  println("log: %u lines, %u dropped, %u waiting (max %u of %u), level %u",
+          logStats.lines, logStats.dropped, logQueueDepth(), logStats.maxDepth, LOG_RING_LINES, logLevel);
+}
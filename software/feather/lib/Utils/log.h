@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+// Logging that never blocks the caller: lines are put into a lock-free ring (any task may log)
+// and written to Serial by a low-priority task. If the ring is full the line is dropped and counted.
+// Format strings without arguments are not copied, only their pointer is queued, so they have to be
+// string literals (as all formats of println() are). Until initLog() is called, and on the host,
+// lines are written right away.
+
+#define LOG_RING_LINES 64                   // power of two
+#define LOG_LINE_LEN 128                    // longer lines are truncated
+#define LOG_TASK_CORE 0
+#define LOG_TASK_PRIORITY 1                 // below everything but idle
+
+enum LogLevel { LOG_ERROR = 0, LOG_WARN = 1, LOG_INFO = 2, LOG_DEBUG = 3 };
+
+struct LogStats {
+  uint32_t lines = 0;                       // lines queued
+  uint32_t dropped = 0;                     // lines lost because the ring was full
+  uint32_t maxDepth = 0;                    // highest number of lines waiting
+};
+extern LogStats logStats;
+
+// lines above this level are suppressed, set from config.debugLevel (LOG_INFO + debugLevel)
+extern uint8_t logLevel;
+
+void initLog();
+void logMessage(LogLevel level, bool newline, const char* format, va_list args);
+void logError(const char* format, ...);
+void logWarn(const char* format, ...);
+void logDebug(const char* format, ...);
+size_t logQueueDepth();
+void flushLog();                            // write all pending lines synchronously from any task, e.g. before a restart
+void printLogStats();
@@ -9,7 +9,7 @@ void ModelConfigDataType::println(const char* format, ...) {
     va_start(args, format);
     vsprintf (s, format, args);
     va_end(args);
-    Serial.println(s);
+    ::println("%s", s);
 };
 
 void ModelConfigDataType::print() {
@@ -31,6 +31,8 @@ void ModelConfigDataType::setup() {
     }
     nextNewNetwork = 0;
     owner[0]  = 0;
+    memset(&lastConnection, 0, sizeof(lastConnection));
+    lastConnection.network = NO_CACHED_NETWORK;
 
 
     // @TODO remove that!!!
@@ -38,6 +40,10 @@ void ModelConfigDataType::setup() {
 }
 
 void ModelConfigDataType::addNetwork(const char* ssid, const char* pass, const char* backendIP) {
+  // the cached connection belongs to the network that is replaced
+  if (lastConnection.network == nextNewNetwork)
+    lastConnection.network = NO_CACHED_NETWORK;
+
   // Store new network
   strncpy(storedNetworks[nextNewNetwork].ssid, ssid, WIFI_CREDENTIAL_LEN);
   strncpy(storedNetworks[nextNewNetwork].pass, pass, WIFI_CREDENTIAL_LEN);
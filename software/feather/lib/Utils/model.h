@@ -8,10 +8,23 @@
 typedef struct {
   char ssid[WIFI_CREDENTIAL_LEN];
   char pass[WIFI_CREDENTIAL_LEN];
-  char backend[WIFI_CREDENTIAL_LEN];
+  char backend[WIFI_CREDENTIAL_LEN];     // host name or dotted address of the backend in this network
 
 } WifiCredential;
 
+// last successful connection, lets the next boot skip the scan, DHCP and DNS
+#define NO_CACHED_NETWORK 0xFF
+typedef struct {
+  uint8_t network;                  // index in storedNetworks, NO_CACHED_NETWORK if invalid
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip;                      // DHCP lease, reused as static configuration
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint32_t backend;                 // resolved address of the backend
+} ConnectionCache;
+
 // contains data stored in EPPROM
 struct ModelConfigDataType {
   void print();
@@ -26,5 +39,7 @@ struct ModelConfigDataType {
   uint8_t nextNewNetwork;
   // the owner 
   char owner[WIFI_CREDENTIAL_LEN];
+  // fast reconnect
+  ConnectionCache lastConnection;
   
 }; 
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+
+#include "modelstore.h"
+
+LoadedModel loadedModel;
+
+void unmapModelPartition(LoadedModel& model) {
+  if (model.mapped)
+    spi_flash_munmap((spi_flash_mmap_handle_t)model.mapHandle);
+  model = LoadedModel();
+}
+
+void unloadModelPartition() {
+  unmapModelPartition(loadedModel);
+}
+
+bool isModelLoaded() {
+  return loadedModel.header != NULL;
+}
+
+bool mapModelPartition(const char* partitionLabel, LoadedModel& model) {
+  model = LoadedModel();
+
+  const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                               (esp_partition_subtype_t)MODEL_PARTITION_SUBTYPE, partitionLabel);
+  if (partition == NULL) {
+    println("model partition %s not found", partitionLabel);
+    return false;
+  }
+
+  // the whole partition is mapped into the data address space, nothing is copied
+  const void* ptr;
+  spi_flash_mmap_handle_t handle;
+  if (esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &ptr, &handle) != ESP_OK) {
+    println("mapping model partition %s failed", partitionLabel);
+    return false;
+  }
+  model.mapHandle = handle;
+  model.mapped = true;
+
+  const ModelContainerHeader* header = (const ModelContainerHeader*)ptr;
+  if ((memcmp(header->magic, MODEL_CONTAINER_MAGIC, 4) != 0) || (header->format != MODEL_CONTAINER_FORMAT) ||
+      (header->headerBytes != sizeof(ModelContainerHeader))) {
+    println("no model in partition %s", partitionLabel);
+    unmapModelPartition(model);
+    return false;
+  }
+  if (esp_rom_crc32_le(0, (const uint8_t*)header, offsetof(ModelContainerHeader, headerCrc)) != header->headerCrc) {
+    println("model header in %s is corrupt", partitionLabel);
+    unmapModelPartition(model);
+    return false;
+  }
+  if ((header->labelCount == 0) || (header->labelCount > MAX_LABELS) ||
+      ((uint64_t)header->modelOffset + header->modelBytes > partition->size)) {
+    println("model in %s does not fit", partitionLabel);
+    unmapModelPartition(model);
+    return false;
+  }
+
+  // one pass over the mapped weights, they are read from the flash cache
+  const uint8_t* weights = (const uint8_t*)ptr + header->modelOffset;
+  if (esp_rom_crc32_le(0, weights, header->modelBytes) != header->modelCrc) {
+    println("model weights in %s are corrupt", partitionLabel);
+    unmapModelPartition(model);
+    return false;
+  }
+
+  model.header = header;
+  model.weights = weights;
+  strncpy(model.partition, partitionLabel, sizeof(model.partition) - 1);
+  return true;
+}
+
+void useModelPartition(LoadedModel& model) {
+  unloadModelPartition();
+  loadedModel = model;
+  model = LoadedModel();                    // the mapping belongs to loadedModel now
+}
+
+bool loadModelPartition(const char* partitionLabel) {
+  LoadedModel model;
+  if (!mapModelPartition(partitionLabel, model))
+    return false;
+  useModelPartition(model);
+  return true;
+}
+
+void printLoadedModel() {
+  if (!isModelLoaded()) {
+    println("no model partition loaded");
+    return;
+  }
+  const ModelContainerHeader* h = loadedModel.header;
+  println("model partition %s: version %u, project %u, %s, %u bytes of weights, arena %u bytes",
+          loadedModel.partition, h->modelVersion, h->projectId, h->language, h->modelBytes, h->arenaSize);
+  for (uint8_t i = 0;i<h->labelCount;i++)
+    println("   label %u: %.*s", i, MODEL_LABEL_LEN, h->labels[i]);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+#include "constants.h"
+
+// Model container in a flash data partition (model0, model1, see partitions.csv), built by software/packmodel.py.
+// The partition is memory-mapped, the weights are used in place without being copied to RAM.
+// All fields little endian, the flatbuffer follows at modelOffset (16 byte aligned).
+
+#define MODEL_PARTITION_SUBTYPE 0x40        // custom data subtype of the model partitions
+#define MODEL_CONTAINER_MAGIC "TTMC"
+#define MODEL_CONTAINER_FORMAT 1
+#define MODEL_LABEL_LEN 24
+
+struct __attribute__((packed)) ModelContainerHeader {
+  char     magic[4];
+  uint16_t format;                          // MODEL_CONTAINER_FORMAT
+  uint16_t headerBytes;                     // sizeof(ModelContainerHeader)
+  uint32_t modelVersion;                    // deploy version of the Edge Impulse project
+  uint32_t projectId;
+  char     language[16];                    // language of the labels, e.g. "Deutsch"
+  // DSP parameters, have to match the DSP block compiled into the firmware
+  uint32_t frequency;                       // [Hz]
+  uint32_t rawSampleCount;                  // samples of one classification window
+  uint32_t inputFrameSize;                  // number of features the network expects
+  uint32_t arenaSize;                       // [bytes] tensor arena the model needs
+  uint8_t  labelCount;
+  uint8_t  reserved[3];
+  char     labels[MAX_LABELS][MODEL_LABEL_LEN];
+  uint32_t modelOffset;                     // tflite flatbuffer, from the start of the container
+  uint32_t modelBytes;
+  uint32_t modelCrc;                        // CRC32 of the flatbuffer
+  uint32_t headerCrc;                       // CRC32 of all header bytes before this field
+};
+
+// a mapped container, valid as long as the partition stays mapped
+struct LoadedModel {
+  const ModelContainerHeader* header = NULL;
+  const uint8_t* weights = NULL;            // flatbuffer, mapped from flash
+  char partition[16] = "";
+  uint32_t mapHandle = 0;                   // spi_flash_mmap_handle_t
+  bool mapped = false;
+};
+extern LoadedModel loadedModel;             // the one the classifier uses
+
+// map and verify the container of the given partition into model, the loaded model stays as it is
+bool mapModelPartition(const char* partitionLabel, LoadedModel& model);
+void unmapModelPartition(LoadedModel& model);
+
+// make a mapped model the loaded one, unmaps the previously loaded one
+void useModelPartition(LoadedModel& model);
+
+// map, verify and use in one step
+bool loadModelPartition(const char* partitionLabel);
+void unloadModelPartition();
+bool isModelLoaded();
+void printLoadedModel();
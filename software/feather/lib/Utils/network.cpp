@@ -1,42 +1,167 @@
 #include "network.h"
 #include "EEPROMStorage.h"
 #include "WifiManager.h"
-#include <HTTPClient.h>
+#include <atomic>
+#include "adpcm.h"
+#include "boot.h"
+#include "heartbeat.h"
+#include "ota.h"
+#include "log.h"
 
 WiFiManager wm;
-String serverUrl;
+AudioCodec audioCodec = CODEC_PCM16;             // codec of audio uploads and streams, set per device in the backend session
+NetworkStats networkStats;
 
 const char* hostname = "www.tiny-turner.com";  // Your domain
 const char* fallbackIP = "192.168.178.80";       // Local server IP
+#define BACKEND_PORT 8000
+
+#define FAST_CONNECT_TIMEOUT_MS 3000             // last good network with cached BSSID, channel and lease
+#define SCAN_CONNECT_TIMEOUT_MS 10000
+#define CAPTIVE_PORTAL_TIMEOUT_S 180
+#define NETWORK_RETRY_MS 30000                   // next attempt after the portal timed out
+#define NETWORK_TASK_STACK_SIZE 8192
+#define BACKEND_TIMEOUT_MS 5000
+
+// IPv4 address of the backend, 0 as long as it is unknown. Set by the DNS task, read by all tasks that talk to the backend
+static std::atomic<uint32_t> backendAddress(0);
+
+// guards the connection to the backend, see backendRequest()
+static SemaphoreHandle_t backendMutex = NULL;
+static StaticSemaphore_t backendMutexBuffer;
+
+// guards the upload connection and the encoder state from beginChunkedUpload() until the upload
+// ends or fails, the recorder, the flight recorder and the terminal upload from different tasks
+static SemaphoreHandle_t uploadMutex = NULL;
+static StaticSemaphore_t uploadMutexBuffer;
+static TaskHandle_t uploadOwner = NULL;
+
+// persist the connection only if something changed, an unchanged reconnect does not write the EEPROM
+static void saveConnectionCache(const ConnectionCache& cache) {
+  if (memcmp(&config.model.lastConnection, &cache, sizeof(cache)) == 0)
+    return;
+  config.model.lastConnection = cache;
+  persConfig.writeConfig();
+}
+
+// backend stored with storedNetworks[network], a host name or a dotted address, our domain if it has none
+static const char* backendName(uint8_t network) {
+  const char* name = config.model.storedNetworks[network].backend;
+  return (name[0] != 0) ? name : hostname;
+}
+
+// resolve the backend of the connected network while the rest of the boot goes on,
+// the cached address is used in the meantime
+static void resolveBackendTask(void* param) {
+  uint8_t network = (uint8_t)(uintptr_t)param;
+  uint32_t start = millis();
+  IPAddress ip;
+  if (WiFi.hostByName(backendName(network), ip) && (uint32_t)ip != 0) {
+    backendAddress.store((uint32_t)ip);
+  } else if (backendAddress.load() == 0) {
+    println("using fallback ip %s", fallbackIP);
+    ip.fromString(fallbackIP);
+    backendAddress.store((uint32_t)ip);
+  }
+  networkStats.dnsMs = millis() - start;
+
+  ConnectionCache cache = config.model.lastConnection;
+  cache.backend = backendAddress.load();
+  saveConnectionCache(cache);
+  vTaskDelete(NULL);
+}
+
+// remember the connection to storedNetworks[network] and start the backend lookup
+static void connected(uint8_t network, bool fast) {
+  networkStats.connectMs = millis() - networkStats.connectStart;
+  networkStats.fastConnect = fast;
+  println("Connected to: %s in %ums%s, ip %s", WiFi.SSID().c_str(), networkStats.connectMs, fast ? " (fast)" : "",
+          WiFi.localIP().toString().c_str());
+
+  ConnectionCache cache = config.model.lastConnection;
+  if (cache.network != network)
+    cache.backend = 0;                           // another network, another route to the backend
+  IPAddress literal;
+  if (literal.fromString(backendName(network)))
+    cache.backend = (uint32_t)literal;           // a dotted address needs no lookup
+  cache.network = network;
+  memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+  cache.channel = WiFi.channel();
+  cache.ip = WiFi.localIP();
+  cache.gateway = WiFi.gatewayIP();
+  cache.subnet = WiFi.subnetMask();
+  cache.dns = WiFi.dnsIP(0);
+  saveConnectionCache(cache);
+
+  backendAddress.store(cache.backend);
+  xTaskCreate(resolveBackendTask, "dns", 4096, (void*)(uintptr_t)network, 1, NULL);
+}
+
+// last good network with its BSSID and channel (no scan) and the previous lease as static IP (no DHCP)
+static bool tryLastConnection() {
+  const ConnectionCache& cache = config.model.lastConnection;
+  if ((cache.network >= MAX_NETWORKS) || (cache.ip == 0))
+    return false;
+  const WifiCredential& network = config.model.storedNetworks[cache.network];
+  if (strlen(network.ssid) == 0)
+    return false;
+
+  networkStats.attempts++;
+  WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+  WiFi.begin(network.ssid, network.pass, cache.channel, cache.bssid);
+  if (WiFi.waitForConnectResult(FAST_CONNECT_TIMEOUT_MS) == WL_CONNECTED) {
+    connected(cache.network, true);
+    return true;
+  }
+
+  // access point or lease changed, back to scan and DHCP
+  println("fast connect to %s failed", network.ssid);
+  WiFi.disconnect();
+  WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+  return false;
+}
 
 bool tryKnownNetworks() {
-  for (int i = 0; i < MAX_NETWORKS; i++) {
-    if (strlen(config.model.storedNetworks[i].ssid) == 0) continue;
-    
-    println("Trying: %s", config.model.storedNetworks[i].ssid);
-    WiFi.begin(config.model.storedNetworks[i].ssid, config.model.storedNetworks[i].pass);
-    
-    if (WiFi.waitForConnectResult(10000) == WL_CONNECTED) {
-      persConfig.writeConfig();
-      println("Connected to: %s", WiFi.SSID().c_str());
-      serverUrl = config.model.storedNetworks[i].backend;
-
-      IPAddress ip;
-      if (WiFi.hostByName(hostname, ip)) {
-        serverUrl="http://" + ip.toString() + ":8000";
-      }
-      else {
-        println("using fallback ip %s", fallbackIP);
-        serverUrl= "http://" + String(fallbackIP) + ":8000";
+  networkStats.connectStart = millis();
+  WiFi.persistent(false);                        // credentials are kept in the EEPROM, not in the WiFi NVS
+  WiFi.mode(WIFI_STA);
+  if (tryLastConnection())
+    return true;
+
+  // one scan, then the stored networks that are in range, strongest first
+  int found = WiFi.scanNetworks();
+  bool tried[MAX_NETWORKS] = { false };
+  for (int attempt = 0; attempt < MAX_NETWORKS; attempt++) {
+    int best = -1, bestNetwork = -1;
+    for (int j = 0; j < found; j++) {
+      for (int i = 0; i < MAX_NETWORKS; i++) {
+        if (tried[i] || (strlen(config.model.storedNetworks[i].ssid) == 0) || (WiFi.SSID(j) != config.model.storedNetworks[i].ssid))
+          continue;
+        if ((best < 0) || (WiFi.RSSI(j) > WiFi.RSSI(best))) {
+          best = j;
+          bestNetwork = i;
+        }
       }
-      
+    }
+    if (best < 0)
+      break;
+    tried[bestNetwork] = true;
+
+    const WifiCredential& network = config.model.storedNetworks[bestNetwork];
+    println("Trying: %s (%i dBm)", network.ssid, WiFi.RSSI(best));
+    networkStats.attempts++;
+    WiFi.begin(network.ssid, network.pass, WiFi.channel(best), WiFi.BSSID(best));
+    if (WiFi.waitForConnectResult(SCAN_CONNECT_TIMEOUT_MS) == WL_CONNECTED) {
+      WiFi.scanDelete();
+      connected(bestNetwork, false);
       return true;
     }
   }
+  WiFi.scanDelete();
   return false;  // No networks connected
 }
 
-void startCaptivePortal() {
+bool startCaptivePortal() {
 
   char serial_field[WIFI_CREDENTIAL_LEN] = "";
   char backend_field[WIFI_CREDENTIAL_LEN] = "";
@@ -57,87 +182,380 @@ void startCaptivePortal() {
   }
 
   // Start portal with 3min timeout
+  wm.setConfigPortalTimeout(CAPTIVE_PORTAL_TIMEOUT_S);
   bool connectSuccess = wm.startConfigPortal("TinyTurner Setup");
   if (!connectSuccess) {
-    println("Failed to connect, restarting.");
-    ESP.restart();
+    println("captive portal timed out");
+    return false;
   }
 
   // Save new credentials
-  config.model.addNetwork(WiFi.SSID().c_str(), WiFi.psk().c_str());
+  uint8_t slot = config.model.nextNewNetwork;
+  const char* backend = custom_backend.getValue();
+  config.model.addNetwork(WiFi.SSID().c_str(), WiFi.psk().c_str(), (backend[0] != 0) ? backend : NULL);
   println("adding new network is %s pw=%s",WiFi.SSID().c_str(), WiFi.psk().c_str());
   if (config.model.owner[0] == 0) {
       strncpy(config.model.owner, custom_serial.getValue(), WIFI_CREDENTIAL_LEN);
 
   }
   persConfig.writeConfig();
+  connected(slot, false);
+  return true;
 }
 
 void setupNetwork() {
-  // Try to connect to known networks
-  bool connected = tryKnownNetworks();
-  
-  // Fallback to captive portal if no connection
-  if (!connected) {
-    startCaptivePortal();
+  // Try to connect to known networks, fallback to captive portal if no connection.
+  // Retried until a network is there, the page turner works without in the meantime
+  while (!tryKnownNetworks()) {
+    if (startCaptivePortal())
+      break;
+    delay(NETWORK_RETRY_MS);
+  }
+}
+
+static TaskHandle_t networkTaskHandle = NULL;
+
+// requests to the network task, notification bits
+#define NETWORK_HEARTBEAT 0x01
+#define NETWORK_UPDATE    0x02
+
+// model first, a new firmware restarts the device
+static void checkForUpdates() {
+  updateFromBackend(OTA_MODEL);
+  if (updateFromBackend(OTA_APP) == OTA_UPDATED) {
+    println("restarting into the new firmware");
+    flushLog();
+    ESP.restart();
+  }
+}
+
+// connects, then stays to send a heartbeat or look for updates whenever it is requested
+static void networkTask(void* param) {
+  setupNetwork();
+  bootStageDone(BOOT_ONLINE);
+  uint32_t requests = NETWORK_HEARTBEAT;
+  while (true) {
+    if (WiFi.status() == WL_CONNECTED) {
+      if (requests & NETWORK_HEARTBEAT)
+        sendHeartbeat();
+      if (requests & NETWORK_UPDATE)
+        checkForUpdates();
+    }
+    xTaskNotifyWait(0, UINT32_MAX, &requests, portMAX_DELAY);
+  }
+}
+
+// WiFi, backend and captive portal in the background, setup() does not wait for it
+void startNetwork() {
+  backendMutex = xSemaphoreCreateMutexStatic(&backendMutexBuffer);
+  uploadMutex = xSemaphoreCreateMutexStatic(&uploadMutexBuffer);
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK_SIZE, NULL, 1, &networkTaskHandle, 1);
+}
+
+// send the heartbeat from the network task, returns immediately
+void requestHeartbeat() {
+  if (networkTaskHandle != NULL)
+    xTaskNotify(networkTaskHandle, NETWORK_HEARTBEAT, eSetBits);
+}
+
+// check for model and firmware updates in the network task, returns immediately
+void requestUpdate() {
+  if (networkTaskHandle != NULL)
+    xTaskNotify(networkTaskHandle, NETWORK_UPDATE, eSetBits);
+}
+
+
+// Requests to the backend (codec) share one kept-alive connection and static buffers,
+// no HTTPClient or String is created per request. The network task and loop() both use it.
+static WiFiClient backendClient;
+static char requestHeader[256];
+static char responseLine[128];
+
+// dotted address of the backend, empty as long as it is unknown
+static void formatBackendHost(char host[16]) {
+  uint32_t address = backendAddress.load();
+  if (address == 0)
+    host[0] = 0;
+  else
+    snprintf(host, 16, "%u.%u.%u.%u", address & 0xFF, (address >> 8) & 0xFF, (address >> 16) & 0xFF, address >> 24);
+}
+
+static bool writeAll(WiFiClient& client, const uint8_t* data, size_t len) {
+  while (len > 0) {
+    size_t written = client.write(data, len);
+    if (written == 0)
+      return false;
+    data += written;
+    len -= written;
+  }
+  return true;
+}
+
+// status line and headers, the body is copied into body (0-terminated) as far as it fits, the rest is skipped
+static int readResponse(char* body, size_t bodySize) {
+  uint32_t start = millis();
+  while (backendClient.connected() && !backendClient.available() && (millis() - start < BACKEND_TIMEOUT_MS))
+    delay(5);
+
+  size_t len = backendClient.readBytesUntil('\n', responseLine, sizeof(responseLine) - 1);
+  responseLine[len] = 0;
+  int code = 0;
+  if (sscanf(responseLine, "HTTP/%*s %d", &code) != 1)
+    return -1;
+  bool keepAlive = (strncmp(responseLine, "HTTP/1.1", 8) == 0);
+
+  size_t contentLength = 0;
+  while (true) {
+    len = backendClient.readBytesUntil('\n', responseLine, sizeof(responseLine) - 1);
+    responseLine[len] = 0;
+    if (len <= 1)
+      break;
+    if (strncasecmp(responseLine, "Content-Length:", 15) == 0)
+      contentLength = strtoul(responseLine + 15, NULL, 10);
+    else if (strncasecmp(responseLine, "Connection: close", 17) == 0)
+      keepAlive = false;
+  }
+
+  size_t copied = 0;
+  if ((body != NULL) && (bodySize > 0)) {
+    copied = backendClient.readBytes(body, min(contentLength, bodySize - 1));
+    body[copied] = 0;
   }
+  for (size_t skipped = copied; skipped < contentLength; skipped++)
+    if (backendClient.read() < 0)
+      break;
+
+  if (!keepAlive)
+    backendClient.stop();
+  return code;
+}
+
+// one request over the kept-alive connection, returns the HTTP status or -1
+static int backendRequest(const char* method, const char* path, const uint8_t* payload, size_t payloadSize, char* body = NULL, size_t bodySize = 0) {
+  if (WiFi.status() != WL_CONNECTED) {
+    println("WiFi disconnected");
+    return -1;
+  }
+  char host[16];
+  formatBackendHost(host);
+  if ((host[0] == 0) || (backendMutex == NULL)) {
+    println("backend server is unknown");
+    return -1;
+  }
+
+  xSemaphoreTake(backendMutex, portMAX_DELAY);
+  int code = -1;
+  // the server may have closed the idle connection in the meantime, then reconnect once
+  for (int attempt = 0; (attempt < 2) && (code < 0); attempt++) {
+    if (!backendClient.connected()) {
+      backendClient.stop();
+      if (!backendClient.connect(IPAddress(backendAddress.load()), BACKEND_PORT))
+        break;
+    }
+    size_t len = snprintf(requestHeader, sizeof(requestHeader),
+                          "%s %s HTTP/1.1\r\n"
+                          "Host: %s:%u\r\n"
+                          "Content-Type: application/octet-stream\r\n"
+                          "Content-Length: %u\r\n"
+                          "Connection: keep-alive\r\n\r\n", method, path, host, BACKEND_PORT, payloadSize);
+    if (writeAll(backendClient, (const uint8_t*)requestHeader, len) && writeAll(backendClient, payload, payloadSize))
+      code = readResponse(body, bodySize);
+    if (code < 0)
+      backendClient.stop();
+  }
+  xSemaphoreGive(backendMutex);
+
+  if (code > 0)
+    println("%s '%s' → %d", method, path, code);
+  else
+    println("%s '%s' failed", method, path);
+  return code;
+}
+
+bool sendAudioSnippet(int16_t audioBuffer[], size_t samples) {
+  println("Sending audio snippet %i", samples);
+  if (!beginAudioUpload())
+    return false;
+  if (!writeUploadAudio(audioBuffer, samples))
+    return false;
+  return endAudioUpload();
+}
+
+// address of the backend, empty as long as it is unknown
+String backendHost() {
+  uint32_t address = backendAddress.load();
+  return (address == 0) ? String("") : IPAddress(address).toString();
+}
+
+uint16_t backendPort() {
+  return BACKEND_PORT;
 }
 
+void printNetworkStats() {
+  println("WiFi: connected in %ums (%s, %u attempts), backend %s resolved in %ums, rssi %i dBm",
+          networkStats.connectMs, networkStats.fastConnect ? "fast" : "scan", networkStats.attempts,
+          backendHost().c_str(), networkStats.dnsMs, WiFi.RSSI());
+}
+
+// path of the audio upload of this device
+void audioUploadPath(char path[], size_t len) {
+  snprintf(path, len, "/api/audio/%llx", (unsigned long long)ESP.getEfuseMac());
+}
+
+// Chunked HTTP upload, the body is written piece by piece directly from the caller's buffers.
+// One upload at a time: the task that began it owns the connection until endChunkedUpload() or a
+// failed write, the others wait in beginChunkedUpload(). Like backendRequest() it formats into
+// static buffers, guarded by the upload mutex, no String is created per upload or chunk.
+static WiFiClient uploadClient;
+static char uploadHeader[256];
+
+static bool ownsUpload() {
+  return uploadOwner == xTaskGetCurrentTaskHandle();
+}
+
+// close the connection and let the next task upload
+static void releaseUpload() {
+  uploadClient.stop();
+  uploadOwner = NULL;
+  xSemaphoreGive(uploadMutex);
+}
 
-bool sendToServer(const char* path, uint8_t* buffer, size_t bufferSize) {
+bool beginChunkedUpload(const char* path, const char* contentType /* = "application/octet-stream" */) {
   if (WiFi.status() != WL_CONNECTED) {
     println("WiFi disconnected");
     return false;
   }
-
-  if (serverUrl == "") {
+  char host[16];
+  formatBackendHost(host);
+  if ((host[0] == 0) || (uploadMutex == NULL)) {
     println("backend server is unknown");
     return false;
   }
 
-  HTTPClient http;
-  String fullpath = serverUrl + path;
-  http.begin(fullpath.c_str());
-  http.addHeader("Content-Type", "application/octet-stream");
-  
-  // Send the payload
-  int code = http.POST(buffer, bufferSize);
-  
-  if (code > 0) {
-    println("POST '%s' → %d\n", fullpath.c_str(), code);
-  } else {
-    println("POST failed:%s %s\n", fullpath.c_str(),http.errorToString(code).c_str());
+  if (xSemaphoreTake(uploadMutex, pdMS_TO_TICKS(BACKEND_TIMEOUT_MS)) != pdTRUE) {
+    println("upload connection busy");
+    return false;
+  }
+  uploadOwner = xTaskGetCurrentTaskHandle();
+  if (!uploadClient.connect(IPAddress(backendAddress.load()), BACKEND_PORT)) {
+    println("upload connect to %s failed", host);
+    releaseUpload();
+    return false;
+  }
+  size_t len = snprintf(uploadHeader, sizeof(uploadHeader),
+                        "POST %s HTTP/1.1\r\n"
+                        "Host: %s:%u\r\n"
+                        "Content-Type: %s\r\n"
+                        "Transfer-Encoding: chunked\r\n"
+                        "Connection: close\r\n\r\n", path, host, BACKEND_PORT, contentType);
+  if ((len >= sizeof(uploadHeader)) || !writeAll(uploadClient, (const uint8_t*)uploadHeader, len)) {
+    println("upload request to %s failed", host);
+    releaseUpload();
+    return false;
   }
-  
-  // Clean up
-  http.end();
+  return true;
+}
 
-  return (code > 0);
+bool writeUploadChunk(const uint8_t* data, size_t len) {
+  if (!ownsUpload())
+    return false;
+  if (len == 0)
+    return true;
+  char size[12];
+  size_t sizeLen = snprintf(size, sizeof(size), "%x\r\n", len);
+  if (!writeAll(uploadClient, (const uint8_t*)size, sizeLen) || !writeAll(uploadClient, data, len) ||
+      !writeAll(uploadClient, (const uint8_t*)"\r\n", 2)) {
+    releaseUpload();
+    return false;
+  }
+  return true;
 }
 
-bool sendToServer(String path, String s) {
-  return sendToServer(path.c_str(),  (uint8_t*)s.c_str(), (size_t)s.length());
-} 
+// send the final chunk and wait for the status line
+bool endChunkedUpload() {
+  if (!ownsUpload())
+    return false;
+  writeAll(uploadClient, (const uint8_t*)"0\r\n\r\n", 5);
+  uint32_t start = millis();
+  while (uploadClient.connected() && !uploadClient.available() && (millis() - start < 5000))
+    delay(10);
 
-bool sendDevice() {
-  String device = String("") +
-    " board:\"" + String(ARDUINO_BOARD) + "\"" +
-    " flash:\"" + String(ESP.getFlashChipSize()) + "\"" +
-    " psram:\"" + String(ESP.getPsramSize()) + "\"" +
-    " freeheap:\"" + String(ESP.getFreeHeap()) + "\"" +
-    " version:\"" + String(VERSION) + "\"" +
-    " cpu:\"" + String(ESP.getCpuFreqMHz()) + "\"" +
-    " cores:\"" + String(ESP.getChipCores()) + "\"" +
-    " chip:\"" + String(ESP.getChipModel()) + "\"" +
-    " owner:\"" + String(config.model.owner) + "\"" +
-    " chipid:\"" + String(ESP.getEfuseMac(), HEX) + "\"";
+  char status[32] = "";
+  size_t len = uploadClient.readBytesUntil('\n', status, sizeof(status) - 1);
+  status[len] = 0;
+  releaseUpload();
 
-  Serial.println("Sending device info: " + device); // Debug output
-  return sendToServer("/api/device-info", device);
+  int code = 0;
+  sscanf(status, "HTTP/%*s %d", &code);
+  println("chunked upload → %d", code);
+  return (code >= 200) && (code < 300);
 }
 
-bool sendAudioSnippet(int16_t audioBuffer[], size_t samples) {
-  println("Sending audio snippet %i", samples);
-  String path =  String("/api/audio/") + String(ESP.getEfuseMac(), HEX);
-  return sendToServer(path.c_str(), (uint8_t*) audioBuffer, samples*BYTES_PER_SAMPLE);
+// ask the backend for the audio codec of this device's session
+AudioCodec fetchAudioCodec() {
+  if ((WiFi.status() != WL_CONNECTED) || (backendAddress.load() == 0))
+    return audioCodec;
+
+  char path[64];
+  snprintf(path, sizeof(path), "/api/session/codec/%llx", (unsigned long long)ESP.getEfuseMac());
+  char codec[16];
+  if (backendRequest("GET", path, NULL, 0, codec, sizeof(codec)) == 200)
+    audioCodec = (strcmp(codec, "adpcm") == 0) ? CODEC_ADPCM : CODEC_PCM16;
+  return audioCodec;
+}
+
+// Audio upload in the codec of the session. ADPCM is encoded incrementally in blocks of
+// ADPCM_BLOCK_SAMPLES, so only one block of PCM and its encoding are buffered. The encoder
+// state belongs to the task that owns the upload.
+static AdpcmEncoder uploadEncoder;
+static AudioCodec uploadCodec = CODEC_PCM16;
+static int16_t pendingPcm[ADPCM_BLOCK_SAMPLES];
+static size_t pendingSamples = 0;
+static uint8_t encodedBlock[ADPCM_BLOCK_BYTES(ADPCM_BLOCK_SAMPLES)];
+
+static bool flushAdpcmBlock() {
+  if (pendingSamples == 0)
+    return true;
+  size_t bytes = uploadEncoder.encodeBlock(pendingPcm, pendingSamples, encodedBlock);
+  pendingSamples = 0;
+  return writeUploadChunk(encodedBlock, bytes);
+}
+
+bool beginAudioUpload(const char* query /* = "" */) {
+  char path[96];
+  audioUploadPath(path, sizeof(path));
+  strncat(path, query, sizeof(path) - strlen(path) - 1);
+  AudioCodec codec = fetchAudioCodec();
+  if (!beginChunkedUpload(path, (codec == CODEC_ADPCM) ? "audio/x-ima-adpcm" : "application/octet-stream"))
+    return false;
+  uploadCodec = codec;
+  uploadEncoder.reset();
+  pendingSamples = 0;
+  return true;
+}
+
+bool writeUploadAudio(const int16_t* samples, size_t len) {
+  if (!ownsUpload())
+    return false;
+  if (uploadCodec == CODEC_PCM16)
+    return writeUploadChunk((const uint8_t*)samples, len * BYTES_PER_SAMPLE);
+
+  while (len > 0) {
+    size_t n = min(len, ADPCM_BLOCK_SAMPLES - pendingSamples);
+    memcpy(&pendingPcm[pendingSamples], samples, n * sizeof(int16_t));
+    pendingSamples += n;
+    samples += n;
+    len -= n;
+    if ((pendingSamples == ADPCM_BLOCK_SAMPLES) && !flushAdpcmBlock())
+      return false;
+  }
+  return true;
+}
+
+bool endAudioUpload() {
+  if (!ownsUpload())
+    return false;
+  if ((uploadCodec == CODEC_ADPCM) && !flushAdpcmBlock())
+    return false;
+  return endChunkedUpload();
 }
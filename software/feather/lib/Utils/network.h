@@ -1,6 +1,33 @@
 #include <Arduino.h>
+#include "adpcm.h"
+
+// connection timing, boot to WiFi ready
+struct NetworkStats {
+  uint32_t connectStart = 0;                    // [ms] since boot
+  uint32_t connectMs = 0;                       // [ms] until associated with an IP
+  uint32_t dnsMs = 0;                           // [ms] backend lookup, runs in the background
+  uint8_t attempts = 0;
+  bool fastConnect = false;                     // connected with the cached BSSID, channel and lease
+};
+
+extern AudioCodec audioCodec;
+extern NetworkStats networkStats;
 
 void setupNetwork();
-void startCaptivePortal();
-bool sendDevice();
+void startNetwork();
+void requestHeartbeat();
+void requestUpdate();
+bool startCaptivePortal();
 bool sendAudioSnippet(int16_t audioBuffer[], size_t samples);
+String backendHost();
+uint16_t backendPort();
+void printNetworkStats();
+void audioUploadPath(char path[], size_t len);
+// one upload at a time across tasks, begin waits for the one in progress, end or a failed write releases it
+bool beginChunkedUpload(const char* path, const char* contentType = "application/octet-stream");
+bool writeUploadChunk(const uint8_t* data, size_t len);
+bool endChunkedUpload();
+AudioCodec fetchAudioCodec();
+bool beginAudioUpload(const char* query = "");      // query is appended to the path, e.g. "?trigger=manual"
+bool writeUploadAudio(const int16_t* samples, size_t len);
+bool endAudioUpload();
@@ -0,0 +1,372 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <esp_image_format.h>
+#include <mbedtls/sha256.h>
+#include "rom/miniz.h"                      // inflate of the ROM, as used by the serial bootloader
+
+#include "ota.h"
+#include "network.h"
+#include "modelstore.h"
+#include "inference.h"
+#include <atomic>
+
+OtaStats otaStats;
+
+// model partition downloaded and verified by the network task, waiting for loop() to switch to it
+static char pendingModel[16];
+static std::atomic<bool> modelPending(false);
+
+#define OTA_INPUT_CHUNK 1024                // [bytes] read from the connection at once
+#define OTA_WRITE_CHUNK 4096                // [bytes] written to flash at once, one sector
+#define OTA_OLD_CHUNK 256                   // [bytes] of the old image read per DIFF step
+
+static const char* targetName(OtaTarget target) {
+  return (target == OTA_APP) ? "app" : "model";
+}
+
+// SHA-256 of the first len bytes of a partition
+static void partitionSha256(const esp_partition_t* partition, uint32_t len, uint8_t sha[32]) {
+  uint8_t buffer[OTA_OLD_CHUNK];
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts(&ctx, 0);
+  for (uint32_t pos = 0; pos < len; pos += sizeof(buffer)) {
+    uint32_t n = min((uint32_t)sizeof(buffer), len - pos);
+    esp_partition_read(partition, pos, buffer, n);
+    mbedtls_sha256_update(&ctx, buffer, n);
+  }
+  mbedtls_sha256_finish(&ctx, sha);
+  mbedtls_sha256_free(&ctx);
+}
+
+// the image the device runs: partition and length, NULL if there is none (no model loaded)
+static const esp_partition_t* runningImage(OtaTarget target, uint32_t &len) {
+  len = 0;
+  if (target == OTA_APP) {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    esp_partition_pos_t pos = { running->address, running->size };
+    esp_image_metadata_t meta;
+    if (esp_image_get_metadata(&pos, &meta) != ESP_OK)
+      return NULL;
+    len = meta.image_len;
+    return running;
+  }
+  if (!isModelLoaded())
+    return NULL;
+  len = loadedModel.header->modelOffset + loadedModel.header->modelBytes;
+  return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)MODEL_PARTITION_SUBTYPE, loadedModel.partition);
+}
+
+// the slot the update is written to
+static const esp_partition_t* inactiveSlot(OtaTarget target) {
+  if (target == OTA_APP)
+    return esp_ota_get_next_update_partition(NULL);
+  const char* label = (isModelLoaded() && (strcmp(loadedModel.partition, "model0") == 0)) ? "model1" : "model0";
+  return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)MODEL_PARTITION_SUBTYPE, label);
+}
+
+// Streaming patch application. The decompressed ops are consumed as they come out of the
+// inflate dictionary, the new image is assembled in one sector-sized buffer.
+struct PatchApplier {
+  tinfl_decompressor inflator;
+  uint8_t dictionary[TINFL_LZ_DICT_SIZE];   // inflate output, wraps around
+  uint8_t input[OTA_INPUT_CHUNK];
+  uint8_t output[OTA_WRITE_CHUNK];
+  uint8_t old[OTA_OLD_CHUNK];
+
+  OtaTarget target;
+  const esp_partition_t* oldPartition;
+  const esp_partition_t* newPartition;
+  esp_ota_handle_t otaHandle;
+  uint32_t oldSize;
+  uint32_t newSize;
+  mbedtls_sha256_context sha;
+
+  OtaPatchOpHeader op;
+  size_t opFill;                            // bytes of the op header received
+  uint32_t opRemaining;                     // data bytes of the current op still to come
+  size_t outputFill;
+  uint32_t written;
+  bool done;
+  bool failed;
+
+  bool flush() {
+    if (outputFill == 0)
+      return true;
+    if (written + outputFill > newSize) {
+      println("patch creates more than %u bytes", newSize);
+      return false;
+    }
+    mbedtls_sha256_update(&sha, output, outputFill);
+    esp_err_t err = (target == OTA_APP) ? esp_ota_write(otaHandle, output, outputFill)
+                                        : esp_partition_write(newPartition, written, output, outputFill);
+    if (err != ESP_OK) {
+      println("writing %s failed (%s)", newPartition->label, esp_err_to_name(err));
+      return false;
+    }
+    written += outputFill;
+    outputFill = 0;
+    return true;
+  }
+
+  // consume decompressed op stream
+  void consume(const uint8_t* data, size_t len) {
+    while ((len > 0) && !done && !failed) {
+      if (opFill < sizeof(op)) {
+        size_t n = min(len, sizeof(op) - opFill);
+        memcpy((uint8_t*)&op + opFill, data, n);
+        opFill += n;
+        data += n;
+        len -= n;
+        if (opFill < sizeof(op))
+          return;
+        if (op.op == OTA_OP_END) {
+          done = true;
+          return;
+        }
+        if (((op.op != OTA_OP_DIFF) && (op.op != OTA_OP_ADD)) ||
+            ((op.op == OTA_OP_DIFF) && ((uint64_t)op.oldOffset + op.len > oldSize))) {
+          println("invalid patch op %u", op.op);
+          failed = true;
+          return;
+        }
+        opRemaining = op.len;
+        if (opRemaining == 0)
+          opFill = 0;
+        continue;
+      }
+
+      size_t n = min(len, min((size_t)opRemaining, sizeof(output) - outputFill));
+      if (op.op == OTA_OP_DIFF) {
+        n = min(n, sizeof(old));
+        esp_partition_read(oldPartition, op.oldOffset, old, n);
+        for (size_t i = 0; i < n; i++)
+          output[outputFill + i] = data[i] + old[i];
+        op.oldOffset += n;
+      } else
+        memcpy(&output[outputFill], data, n);
+      outputFill += n;
+      data += n;
+      len -= n;
+      opRemaining -= n;
+      if (opRemaining == 0)
+        opFill = 0;
+      if ((outputFill == sizeof(output)) && !flush())
+        failed = true;
+    }
+  }
+};
+
+static bool readFully(WiFiClient* stream, uint8_t* buffer, size_t len) {
+  return stream->readBytes(buffer, len) == len;
+}
+
+static void reportUpdate(OtaTarget target, const char* result) {
+  char path[48];
+  snprintf(path, sizeof(path), "/api/ota/report/%llx", (unsigned long long)ESP.getEfuseMac());
+  char report[64];
+  snprintf(report, sizeof(report), "%s %s %u %u", targetName(target), result, otaStats.patchBytes, otaStats.durationMs);
+  HTTPClient http;
+  http.begin(backendHost(), backendPort(), path);
+  http.POST((uint8_t*)report, strlen(report));
+  http.end();
+}
+
+// download the patch and apply it into the inactive slot
+static OtaResult applyPatch(OtaTarget target, WiFiClient* stream, const esp_partition_t* oldPartition, uint32_t oldLen) {
+  OtaPatchHeader header;
+  if (!readFully(stream, (uint8_t*)&header, sizeof(header)) || (memcmp(header.magic, OTA_PATCH_MAGIC, 4) != 0) ||
+      (header.format != OTA_PATCH_FORMAT) || (header.target != target)) {
+    println("no valid %s patch", targetName(target));
+    return OTA_FAILED;
+  }
+  otaStats.patchBytes = sizeof(header) + header.payloadBytes;
+
+  // the patch has to be made for exactly what is running
+  if (header.oldSize > 0) {
+    uint8_t sha[32];
+    if (oldPartition != NULL)
+      partitionSha256(oldPartition, header.oldSize, sha);
+    if ((oldPartition == NULL) || (header.oldSize != oldLen) || (memcmp(sha, header.oldSha, 32) != 0)) {
+      println("patch does not apply to the running %s", targetName(target));
+      return OTA_FAILED;
+    }
+  }
+
+  const esp_partition_t* slot = inactiveSlot(target);
+  if ((slot == NULL) || (header.newSize > slot->size)) {
+    println("no slot for a %s of %u bytes", targetName(target), header.newSize);
+    return OTA_FAILED;
+  }
+
+  PatchApplier* applier = (PatchApplier*)malloc(sizeof(PatchApplier));
+  if (applier == NULL) {
+    println("not enough memory for the update (%u bytes)", sizeof(PatchApplier));
+    return OTA_FAILED;
+  }
+  PatchApplier& a = *applier;
+  a.target = target;
+  a.oldPartition = oldPartition;
+  a.newPartition = slot;
+  a.oldSize = header.oldSize;
+  a.newSize = header.newSize;
+  a.opFill = a.opRemaining = a.outputFill = a.written = 0;
+  a.done = a.failed = false;
+  mbedtls_sha256_init(&a.sha);
+  mbedtls_sha256_starts(&a.sha, 0);
+  tinfl_init(&a.inflator);
+
+  esp_err_t err = (target == OTA_APP) ? esp_ota_begin(slot, header.newSize, &a.otaHandle)
+                                      : esp_partition_erase_range(slot, 0, (header.newSize + 4095) & ~4095);
+  if (err != ESP_OK) {
+    println("preparing %s failed (%s)", slot->label, esp_err_to_name(err));
+    mbedtls_sha256_free(&a.sha);
+    free(applier);
+    return OTA_FAILED;
+  }
+  println("updating %s into %s: %u bytes -> %u bytes with a patch of %u bytes",
+          targetName(target), slot->label, header.oldSize, header.newSize, header.payloadBytes);
+
+  uint32_t remaining = header.payloadBytes;
+  uint32_t dictPos = 0;
+  size_t inputFill = 0;
+  const uint8_t* inputPos = a.input;
+  tinfl_status status = TINFL_STATUS_NEEDS_MORE_INPUT;
+  while (!a.done && !a.failed) {
+    if ((inputFill == 0) && (remaining > 0)) {
+      inputFill = min((uint32_t)sizeof(a.input), remaining);
+      if (!readFully(stream, a.input, inputFill)) {
+        println("connection lost after %u of %u bytes", header.payloadBytes - remaining, header.payloadBytes);
+        a.failed = true;
+        break;
+      }
+      remaining -= inputFill;
+      inputPos = a.input;
+    }
+    size_t in = inputFill;
+    size_t out = TINFL_LZ_DICT_SIZE - dictPos;
+    status = tinfl_decompress(&a.inflator, inputPos, &in, a.dictionary, a.dictionary + dictPos, &out,
+                              TINFL_FLAG_PARSE_ZLIB_HEADER | ((remaining > 0) ? TINFL_FLAG_HAS_MORE_INPUT : 0));
+    inputPos += in;
+    inputFill -= in;
+    a.consume(a.dictionary + dictPos, out);
+    dictPos = (dictPos + out) & (TINFL_LZ_DICT_SIZE - 1);
+    if ((status < TINFL_STATUS_DONE) || ((status == TINFL_STATUS_DONE) && !a.done) ||
+        ((status == TINFL_STATUS_NEEDS_MORE_INPUT) && (inputFill == 0) && (remaining == 0))) {
+      println("corrupt patch stream (%d)", status);
+      a.failed = true;
+    }
+  }
+  if (!a.failed && !a.flush())
+    a.failed = true;
+
+  // integrity of the new image before it is used
+  uint8_t sha[32];
+  mbedtls_sha256_finish(&a.sha, sha);
+  mbedtls_sha256_free(&a.sha);
+  if (!a.failed && ((a.written != header.newSize) || (memcmp(sha, header.newSha, 32) != 0))) {
+    println("new %s does not verify (%u bytes written)", targetName(target), a.written);
+    a.failed = true;
+  }
+  bool failed = a.failed;
+  esp_ota_handle_t otaHandle = a.otaHandle;
+  free(applier);
+
+  if (target == OTA_APP) {
+    if (failed) {
+      esp_ota_abort(otaHandle);
+      return OTA_FAILED;
+    }
+    // esp_ota_end checks the image format and its appended hash once more
+    if (((err = esp_ota_end(otaHandle)) != ESP_OK) || ((err = esp_ota_set_boot_partition(slot)) != ESP_OK)) {
+      println("activating %s failed (%s)", slot->label, esp_err_to_name(err));
+      return OTA_FAILED;
+    }
+    otaStats.imageBytes = header.newSize;
+    return OTA_UPDATED;
+  }
+
+  // the model is checked against the DSP block here, the switch is up to loop()
+  if (failed || !checkModelPartition(slot->label))
+    return OTA_FAILED;
+  strncpy(pendingModel, slot->label, sizeof(pendingModel) - 1);
+  modelPending.store(true);
+  otaStats.imageBytes = header.newSize;
+  return OTA_UPDATED;
+}
+
+OtaResult updateFromBackend(OtaTarget target) {
+#if !MODEL_FROM_PARTITION
+  if (target == OTA_MODEL) {
+    println("model is compiled into the firmware, no model update");
+    return OTA_UP_TO_DATE;
+  }
+#endif
+  if ((target == OTA_MODEL) && modelPending.load()) {
+    println("the last model update is not active yet");
+    return OTA_UP_TO_DATE;
+  }
+  if ((WiFi.status() != WL_CONNECTED) || (backendHost() == "")) {
+    println("no connection to the backend");
+    return OTA_FAILED;
+  }
+  uint32_t start = millis();
+  otaStats.patchBytes = otaStats.imageBytes = 0;
+
+  uint32_t oldLen;
+  const esp_partition_t* oldPartition = runningImage(target, oldLen);
+  char shaHex[65] = "";
+  if (oldPartition != NULL) {
+    uint8_t sha[32];
+    partitionSha256(oldPartition, oldLen, sha);
+    for (int i = 0; i < 32; i++)
+      sprintf(&shaHex[i * 2], "%02x", sha[i]);
+  }
+
+  char path[128];
+  snprintf(path, sizeof(path), "/api/ota/%s/%llx?sha=%s", targetName(target), (unsigned long long)ESP.getEfuseMac(), shaHex);
+  HTTPClient http;
+  http.setTimeout(10000);
+  http.begin(backendHost(), backendPort(), path);
+  int code = http.GET();
+  if (code == 204) {
+    http.end();
+    println("%s is up to date", targetName(target));
+    return OTA_UP_TO_DATE;
+  }
+  if (code != 200) {
+    println("OTA request failed → %d", code);
+    http.end();
+    return OTA_FAILED;
+  }
+
+  WiFiClient* stream = http.getStreamPtr();
+  stream->setTimeout(10000);
+  OtaResult result = applyPatch(target, stream, oldPartition, oldLen);
+  http.end();
+
+  otaStats.durationMs = millis() - start;
+  if (result == OTA_UPDATED)
+    otaStats.updates++;
+  else
+    otaStats.failures++;
+  printOtaStats();
+  reportUpdate(target, (result == OTA_UPDATED) ? "updated" : "failed");
+  return result;
+}
+
+bool activatePendingModel() {
+  if (!modelPending.load())
+    return false;
+  bool ok = selectModelPartition(pendingModel);
+  modelPending.store(false);
+  return ok;
+}
+
+void printOtaStats() {
+  println("OTA: last update %u bytes transferred for an image of %u bytes in %ums, %u updates, %u failures",
+          otaStats.patchBytes, otaStats.imageBytes, otaStats.durationMs, otaStats.updates, otaStats.failures);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Arduino.h>
+
+// OTA updates of firmware and model from the backend (webserver/OtaManager.py).
+// The device sends the SHA-256 of the image it runs and gets a delta patch against it
+// (webserver/otadelta.py, a full image if the backend does not know it). The patch is applied
+// while it is downloaded into the inactive slot (ota_0/ota_1, model0/model1) with a fixed set of
+// buffers, the new image is verified before it is booted or loaded.
+
+#define OTA_PATCH_MAGIC "TTDP"
+#define OTA_PATCH_FORMAT 1
+
+enum OtaTarget { OTA_APP = 0, OTA_MODEL = 1 };
+enum OtaResult { OTA_UP_TO_DATE, OTA_UPDATED, OTA_FAILED };
+
+// header of a patch, followed by a zlib stream of ops, all fields little endian
+struct __attribute__((packed)) OtaPatchHeader {
+  char     magic[4];
+  uint8_t  format;                          // OTA_PATCH_FORMAT
+  uint8_t  target;                          // OtaTarget
+  uint16_t reserved;
+  uint32_t oldSize;                         // image the patch applies to, 0 for a full image
+  uint8_t  oldSha[32];
+  uint32_t newSize;
+  uint8_t  newSha[32];
+  uint32_t payloadBytes;                    // length of the zlib stream
+};
+
+// op header, DIFF adds len bytes to the old image at oldOffset, ADD carries len new bytes
+enum OtaPatchOp : uint8_t { OTA_OP_END = 0, OTA_OP_DIFF = 1, OTA_OP_ADD = 2 };
+struct __attribute__((packed)) OtaPatchOpHeader {
+  uint8_t  op;
+  uint32_t oldOffset;
+  uint32_t len;
+};
+
+struct OtaStats {
+  uint32_t patchBytes = 0;                  // bytes transferred
+  uint32_t imageBytes = 0;                  // size of the new image
+  uint32_t durationMs = 0;                  // request until the verified image
+  uint32_t updates = 0;
+  uint32_t failures = 0;
+};
+extern OtaStats otaStats;
+
+// Check for and apply an update, in the network task (requestUpdate()). A new firmware becomes
+// active with the next restart. A new model is verified against the firmware there and switched to
+// by loop() with activatePendingModel(), the classifier belongs to loop(). Firmware built without
+// MODEL_FROM_PARTITION has its model compiled in, it gets no model updates.
+OtaResult updateFromBackend(OtaTarget target);
+
+// switch to a model the network task has downloaded, true if switched (initPipeline() afterwards)
+bool activatePendingModel();
+void printOtaStats();
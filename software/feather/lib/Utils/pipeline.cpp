@@ -0,0 +1,202 @@
+#include <Arduino.h>
+#include "pipeline.h"
+#include "constants.h"
+#include "soundtools.h"
+#include "inference.h"
+#include "energy.h"
+#include "cascade.h"
+
+PipelineTiming pipelineTiming;
+PipelineCounters pipelineCounters;
+PipelineDecision lastDecision = { -1, 0, 0, 0 };
+DecisionConfig decisionConfig;
+
+static uint32_t slicePos = 0;                           // ring position of the next slice
+static SlidingEnergy windowEnergy;
+static DecisionEngine decisionEngine;
+static SliceObserver sliceObserver = NULL;
+static bool classifierInSync = false;                   // the classifier has seen every slice up to slicePos
+static uint32_t refillPos = 0;                          // ring position of the next slice to replay
+static uint32_t refillLeft = 0;                         // slices still to replay
+static bool sliceWaiting = false;                       // front end done, the slice waits for the refill
+static uint32_t statsStart_ms = 0;
+
+void setSliceObserver(SliceObserver observer) {
+  sliceObserver = observer;
+}
+
+void initPipeline() {
+  resetContinuousInference();
+  slicePos = audioRing.written();
+  windowEnergy.init(SAMPLES_IN_SNIPPET / get_slice_size(), get_slice_size());
+  initCascade();
+  audioGain.reset();
+  classifierInSync = true;
+  refillLeft = 0;
+  sliceWaiting = false;
+
+  decisionEngine.init(decisionConfig, get_no_of_labels());
+  decisionEngine.setCommand(weiter_label_no, TURN_PAGE_DOWN);
+  decisionEngine.setCommand(zurueck_label_no, TURN_PAGE_UP);
+}
+
+// feeds the full probability vector of one inference into the decision engine
+PageTurnType decidePageTurn(const float* confidence) {
+  return decisionEngine.update(confidence, millis());
+}
+
+// The continuous classifier needs every slice of its window. After it skipped slices, the window
+// is refilled from the ring with the slices preceding the one that woke it up. The refill is spread
+// over successive calls, one slice each, the audio task must not block for a whole window.
+static void startRefill(uint32_t pos, size_t sliceSize) {
+  resetContinuousInference();
+  cascadeStats.stage2Activations++;
+  refillLeft = SAMPLES_IN_SNIPPET / sliceSize - 1;
+  refillPos = pos - refillLeft * sliceSize;
+  classifierInSync = (refillLeft == 0);
+}
+
+// replays the next slice
+static void refillClassifier(size_t sliceSize) {
+  static int16_t slice[SAMPLES_IN_SNIPPET];
+  static float confidence[MAX_LABELS];
+  int pred_no;
+
+  uint32_t t0 = micros();
+  if (audioRing.read(refillPos, slice, sliceSize)) {
+    if (agcConfig.enabled)
+      audioGain.apply(slice, sliceSize);
+    runInferenceSlice(slice, confidence, pred_no);
+    cascadeStats.stage2Runs++;
+  }
+  pipelineTiming.refill.add(micros() - t0);
+  refillPos += sliceSize;
+  refillLeft--;
+  classifierInSync = (refillLeft == 0);
+}
+
+// Continuous inference: every new slice is featurized once and classified on the rolling feature matrix.
+// With the cascade enabled the classifier only runs on slices stage 1 considers speech-like.
+// Consumes all complete slices in audioRing and returns the page turn, if one has been decided.
+// While the classifier is refilled the slice that woke it up waits, one replayed slice per call.
+PageTurnType processPendingSlices() {
+  static int16_t slice[SAMPLES_IN_SNIPPET];
+  static bool silent, classify;                         // of the slice, kept while it waits
+  const size_t sliceSize = get_slice_size();
+  PageTurnType turn = TURN_NONE;
+
+  while (sliceWaiting || (audioRing.written() - slicePos >= sliceSize)) {
+    if (!sliceWaiting) {
+      uint32_t t0 = micros();
+      if (!audioRing.read(slicePos, slice, sliceSize)) {
+        // we fell behind by more than the ring, continue with the latest slice
+        slicePos = audioRing.written() - sliceSize;
+        continue;
+      }
+      slicePos += sliceSize;
+
+      // shared front end, silence gate on the energy of the last second and stage 1 of the cascade,
+      // both on the slice as captured, the gain must not lift noise over the gate
+      uint32_t t1 = micros();
+      static SliceFeatures features;
+      computeSliceFeatures(slice, sliceSize, features);
+      windowEnergy.addEnergy(features.energy);
+      silent = windowEnergy.isBelow(SILENCE_MEAN_SQUARE);
+      classify = cascadeNeedsClassifier(features) && !(cascadeConfig.enabled && silent);
+
+      // gain control, the classifier sees the levelled slice
+      uint32_t t2 = micros();
+      if (agcConfig.enabled)
+        levelAudio(slice, sliceSize);
+      uint32_t t3 = micros();
+
+      pipelineTiming.read.add(t1 - t0);
+      pipelineTiming.gate.add(t2 - t1);
+      pipelineTiming.level.add(t3 - t2);
+
+      if (classify && !classifierInSync) {
+        startRefill(slicePos - sliceSize, sliceSize);
+        sliceWaiting = true;
+      }
+    }
+    if (sliceWaiting) {
+      // one replayed slice per call, the waiting slice follows in the call after the last one
+      if (refillLeft > 0) {
+        refillClassifier(sliceSize);
+        return turn;
+      }
+      sliceWaiting = false;
+    }
+
+    // stage 2: feature extraction and classification
+    uint32_t t3 = micros();
+    int pred_no = -1;
+    static float confidence[MAX_LABELS]; 
+    if (classify) {
+      runInferenceSlice(slice, confidence, pred_no);
+      cascadeStats.stage2Runs++;
+    } else {
+      classifierInSync = false;
+      for (uint8_t i = 0;i<MAX_LABELS;i++)
+        confidence[i] = 0.0;
+    }
+    float pred_certainty = (pred_no >= 0) ? confidence[pred_no] : 0.0;
+
+    // Silence overrides the classifier, the decision engine sees a certain silence.
+    if (silent) {
+      pred_no = silence_label_no;
+      pred_certainty = 1.0;
+      for (uint8_t i = 0;i<MAX_LABELS;i++)
+        confidence[i] = (i == silence_label_no) ? 1.0 : 0.0;
+    }
+
+    uint32_t t4 = micros();
+    PageTurnType t = decidePageTurn(confidence);
+    uint32_t t5 = micros();
+
+    lastDecision.pred_no = pred_no;
+    lastDecision.certainty = pred_certainty;
+    lastDecision.rms = windowEnergy.rms();
+    if (t != TURN_NONE) {
+      // report the command that fired
+      turn = t;
+      cascadeStats.stage2Triggers++;
+      lastDecision.pred_no = decisionEngine.firedLabel();
+      lastDecision.certainty = confidence[lastDecision.pred_no];
+      lastDecision.smoothed = decisionEngine.smoothed(lastDecision.pred_no);
+      if ((lastDecision.pred_no >= 0) && (lastDecision.pred_no < MAX_LABELS))
+        pipelineCounters.labelTurns[lastDecision.pred_no]++;
+    }
+    if ((pred_no >= 0) && (pred_no < MAX_LABELS))
+      pipelineCounters.sliceWinners[pred_no]++;
+    if (classify)
+      pipelineCounters.inferenceLatency.add(t4 - t3);
+    if (sliceObserver != NULL)
+      sliceObserver(confidence, t);
+
+    pipelineTiming.inference.add(t4 - t3);
+    pipelineTiming.decision.add(t5 - t4);
+  }
+
+  return turn;
+}
+
+void resetPipelineStats() {
+  pipelineTiming = PipelineTiming();
+  cascadeStats = CascadeStats();
+  statsStart_ms = millis();
+}
+
+// cpu duty cycle of the pipeline and the counters of the cascade since the last reset
+void printPipelineStats() {
+  uint64_t busy_us = pipelineTiming.read.total_us + pipelineTiming.level.total_us + pipelineTiming.gate.total_us +
+                     pipelineTiming.inference.total_us + pipelineTiming.refill.total_us + pipelineTiming.decision.total_us;
+  uint32_t elapsed_ms = millis() - statsStart_ms;
+  println("pipeline: cascade %s, duty cycle %.1f%% over %u s",
+          cascadeConfig.enabled ? "on" : "off", (elapsed_ms > 0) ? busy_us / (10.0 * elapsed_ms) : 0.0, elapsed_ms / 1000);
+  println("   slices %u, stage 1 triggers %u, stage 2 activations %u, classifier runs %u, page turns %u",
+          cascadeStats.slices, cascadeStats.stage1Triggers, cascadeStats.stage2Activations, cascadeStats.stage2Runs, cascadeStats.stage2Triggers);
+  println("   mean per slice: read %.0f us, AGC %.0f us, gate %.0f us, inference %.0f us, decision %.0f us",
+          pipelineTiming.read.mean_us(), pipelineTiming.level.mean_us(), pipelineTiming.gate.mean_us(), pipelineTiming.inference.mean_us(), pipelineTiming.decision.mean_us());
+  println("   refill: %u slices replayed, mean %.0f us max %u us", pipelineTiming.refill.count, pipelineTiming.refill.mean_us(), pipelineTiming.refill.max_us);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Arduino.h>
+#include "decision.h"
+
+// Production pipeline: slices from audioRing -> silence gate and cascade stage 1 -> inference -> decision engine.
+// Shared by the firmware and the host simulation, so both run the same code.
+
+// accumulated runtime of one stage
+struct StageTime {
+  uint64_t total_us = 0;
+  uint32_t max_us = 0;
+  uint32_t count = 0;
+
+  void add(uint32_t us) {
+    total_us += us;
+    if (us > max_us)
+      max_us = us;
+    count++;
+  }
+  float mean_us() const { return (count > 0) ? (float)total_us / count : 0; }
+};
+
+struct PipelineTiming {
+  StageTime read;                     // copy of the slice out of the ring
+  StageTime level;                    // automatic gain control of the slice
+  StageTime gate;                     // shared front end, silence gate and stage 1 of the cascade
+  StageTime inference;                // feature extraction and classification (stage 2)
+  StageTime refill;                   // replay of one earlier slice after the classifier skipped slices
+  StageTime decision;                 // posterior smoothing and decision
+};
+extern PipelineTiming pipelineTiming;
+
+// latency in power-of-two buckets: up to LATENCY_BUCKET_0_US, twice that, ..., the last one is open ended
+#define LATENCY_BUCKETS 8
+#define LATENCY_BUCKET_0_US 4000
+
+struct LatencyHistogram {
+  uint32_t counts[LATENCY_BUCKETS] = { 0 };
+
+  void add(uint32_t us) {
+    uint8_t bucket = 0;
+    for (uint32_t limit = LATENCY_BUCKET_0_US; (us > limit) && (bucket < LATENCY_BUCKETS - 1); limit *= 2)
+      bucket++;
+    counts[bucket]++;
+  }
+};
+
+// counters since boot, resetPipelineStats() leaves them alone (the heartbeat sends them, the backend builds the deltas)
+struct PipelineCounters {
+  LatencyHistogram inferenceLatency;          // slices that ran the classifier
+  uint32_t sliceWinners[MAX_LABELS] = { 0 };  // most likely label per slice, silence included
+  uint32_t labelTurns[MAX_LABELS] = { 0 };    // page turns per command label
+};
+extern PipelineCounters pipelineCounters;
+
+// last decision, for printing
+struct PipelineDecision {
+  int pred_no;
+  float certainty;                    // probability of the last inference
+  float smoothed;                     // smoothed probability the decision was based on
+  float rms;
+};
+extern PipelineDecision lastDecision;
+
+// configuration of the decision engine, applied by initPipeline()
+extern DecisionConfig decisionConfig;
+
+// optional observer, called with the probability vector (after the silence gate) of every slice
+typedef void (*SliceObserver)(const float* confidence, PageTurnType turn);
+void setSliceObserver(SliceObserver observer);
+
+void initPipeline();
+PageTurnType processPendingSlices();
+PageTurnType decidePageTurn(const float* confidence);
+void resetPipelineStats();
+void printPipelineStats();
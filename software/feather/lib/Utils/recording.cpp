@@ -0,0 +1,247 @@
+#include <Arduino.h>
+#include <new>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+#include "recording.h"
+#include "constants.h"
+#include "soundtools.h"
+#include "network.h"
+#include "flightrecorder.h"
+#include "inference.h"
+#include "streaming.h"
+
+typedef RingBuffer<int16_t, RECORDING_RING_SIZE> RecordingRing;
+
+RecorderStats recorderStats;
+
+static RecordingRing* recordingRing = NULL;         // in PSRAM, NULL if the board has none (recorder off)
+static volatile bool recording = false;             // capture task writes into recordingRing
+static volatile bool uploading = false;             // upload task is sending a take
+static volatile bool stopRequested = false;
+static volatile bool beginPending = false;          // the upload task still has to open the upload
+static volatile bool streamingTake = false;         // the take goes out as stream frames, not as upload
+static uint32_t takeStartPos = 0;                   // ring position where the take started
+static volatile uint32_t takeEndPos = 0;            // ring position where the take ended
+static uint32_t uploadPos = 0;                      // ring position of the next sample to upload
+
+// streamed take: loop() classifies a second, the upload task sends it
+struct StreamFrameInfo {
+  uint32_t pos;                                     // ring position of the first sample
+  uint8_t flags;
+  float confidence[MAX_LABELS];
+};
+static QueueHandle_t streamFrames = NULL;
+static StaticQueue_t streamFramesBuffer;
+static uint8_t streamFramesStorage[STREAM_FRAME_QUEUE_LEN * sizeof(StreamFrameInfo)];
+static int16_t* classifyBuffer = NULL;              // [SAMPLES_IN_SNIPPET] in PSRAM, used by loop()
+static int16_t* frameBuffer = NULL;                 // [SAMPLES_IN_SNIPPET] in PSRAM, used by the upload task
+static uint32_t streamPos = 0;                      // next frame to classify
+static bool firstFrame = true;
+
+static const uint16_t uploadTaskCore = 1;
+static const uint16_t uploadTaskPriority = 1;
+
+// upload everything that has been recorded since the last call, directly out of the ring
+static bool uploadPending(const RecordingRing &ring, uint32_t endPos, bool final) {
+  while (endPos - uploadPos >= (final ? 1 : RECORDING_CHUNK)) {
+    if (!ring.isValid(uploadPos, 1)) {
+      // the ring lapped the upload, skip what is gone
+      uint32_t resumePos = ring.written() - RecordingRing::capacity() + RECORDING_CHUNK;
+      recorderStats.lostSamples += resumePos - uploadPos;
+      uploadPos = resumePos;
+      continue;
+    }
+
+    size_t len = endPos - uploadPos;
+    if (len > RECORDING_CHUNK)
+      len = RECORDING_CHUNK;
+
+    const int16_t *part1, *part2;
+    size_t len1, len2;
+    ring.view(uploadPos, len, part1, len1, part2, len2);
+    if (!writeUploadAudio(part1, len1) || !writeUploadAudio(part2, len2))
+      return false;
+    uploadPos += len;
+    recorderStats.uploadedSamples += len;
+  }
+  return true;
+}
+
+// send the classified frames of a streamed take, ends the take after the last one
+static void sendStreamFrames() {
+  StreamFrameInfo info;
+  while (uploading && (xQueueReceive(streamFrames, &info, 0) == pdTRUE)) {
+    const int16_t *part1, *part2;
+    size_t len1, len2;
+    recordingRing->view(info.pos, SAMPLES_IN_SNIPPET, part1, len1, part2, len2);
+    if (len2 > 0) {
+      memcpy(frameBuffer, part1, len1 * sizeof(int16_t));
+      memcpy(frameBuffer + len1, part2, len2 * sizeof(int16_t));
+      part1 = frameBuffer;
+    }
+    bool ok = recordingRing->isValid(info.pos, SAMPLES_IN_SNIPPET) &&
+              sendAudioFrame(part1, SAMPLES_IN_SNIPPET, info.flags, info.confidence, get_no_of_labels());
+    if (!ok) {
+      println("streaming failed after %u frames", recorderStats.streamedFrames);
+      recording = false;
+      uploading = false;
+      return;
+    }
+    recorderStats.streamedFrames++;
+    recorderStats.uploadedSamples += SAMPLES_IN_SNIPPET;
+    if (info.flags & STREAM_FLAG_END) {
+      println("streamed %u frames", recorderStats.streamedFrames);
+      uploading = false;
+    }
+  }
+}
+
+static void uploadTask(void* param) {
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(20));
+    if (!uploading)
+      continue;
+
+    // connecting may take a while, that is why it is done here and not by the caller
+    if (beginPending) {
+      beginPending = false;
+      if (streamingTake)
+        fetchAudioCodec();
+      else if (!beginAudioUpload()) {
+        println("recording upload could not be started");
+        recording = false;
+        uploading = false;
+        continue;
+      }
+    }
+    if (streamingTake) {
+      sendStreamFrames();
+      continue;
+    }
+
+    bool final = stopRequested;
+    uint32_t endPos = final ? takeEndPos : recordingRing->written();
+    if (!uploadPending(*recordingRing, endPos, final)) {
+      println("recording upload failed after %u samples", recorderStats.uploadedSamples);
+      recording = false;
+      uploading = false;
+      continue;
+    }
+
+    if (final && (uploadPos == endPos)) {
+      endAudioUpload();
+      println("recording of %u samples uploaded, %u lost", recorderStats.uploadedSamples, recorderStats.lostSamples);
+      uploading = false;
+    }
+  }
+}
+
+void initRecorder() {
+  if (ESP.getPsramSize() > 0) {
+    void* mem = ps_malloc(sizeof(RecordingRing));
+    if (mem != NULL)
+      recordingRing = new (mem) RecordingRing();
+  }
+  if (recordingRing == NULL) {
+    println("no PSRAM, recording off");
+    return;
+  }
+  println("recording ring of %u s in PSRAM", RECORDING_RING_SIZE / SAMPLE_RATE);
+
+  classifyBuffer = (int16_t*)ps_malloc(SAMPLES_IN_SNIPPET * sizeof(int16_t));
+  frameBuffer = (int16_t*)ps_malloc(SAMPLES_IN_SNIPPET * sizeof(int16_t));
+  streamFrames = xQueueCreateStatic(STREAM_FRAME_QUEUE_LEN, sizeof(StreamFrameInfo), streamFramesStorage, &streamFramesBuffer);
+
+  xTaskCreatePinnedToCore(uploadTask, "recUpload", 4096, NULL, uploadTaskPriority, NULL, uploadTaskCore);
+}
+
+static bool startTake(bool streamed) {
+  if (recordingRing == NULL) {
+    println("recording needs PSRAM");
+    return false;
+  }
+  if (recording || uploading || isFlightUploading()) {
+    println("recording still in progress");
+    return false;
+  }
+
+  recorderStats = RecorderStats();
+  takeStartPos = recordingRing->written();
+  uploadPos = takeStartPos;
+  streamPos = takeStartPos;
+  firstFrame = true;
+  xQueueReset(streamFrames);
+  stopRequested = false;
+  streamingTake = streamed;
+  beginPending = true;
+  recording = true;
+  uploading = true;
+  return true;
+}
+
+bool startRecording() {
+  return startTake(false);
+}
+
+bool startStreaming() {
+  if ((recordingRing != NULL) && ((classifyBuffer == NULL) || (frameBuffer == NULL))) {
+    println("no PSRAM left for streaming");
+    return false;
+  }
+  return startTake(true);
+}
+
+bool processStreaming(bool hold) {
+  if (!streamingTake || !recording)
+    return false;
+  if (recordingRing->written() - streamPos < SAMPLES_IN_SNIPPET)
+    return true;
+
+  StreamFrameInfo info;
+  if (!recordingRing->read(streamPos, classifyBuffer, SAMPLES_IN_SNIPPET)) {
+    // the upload fell behind by more than the ring, continue with the latest second
+    streamPos = recordingRing->written() - SAMPLES_IN_SNIPPET;
+    recordingRing->read(streamPos, classifyBuffer, SAMPLES_IN_SNIPPET);
+  }
+  int pred_no;
+  runInference(classifyBuffer, SAMPLES_IN_SNIPPET, info.confidence, pred_no);
+  info.pos = streamPos;
+  info.flags = (firstFrame ? STREAM_FLAG_START : 0) | (hold ? 0 : STREAM_FLAG_END);
+  firstFrame = false;
+  streamPos += SAMPLES_IN_SNIPPET;
+
+  if (xQueueSend(streamFrames, &info, 0) != pdTRUE) {
+    // the upload task is a whole queue behind, this second is lost
+    recorderStats.lostSamples += SAMPLES_IN_SNIPPET;
+    if (!hold)
+      uploading = false;
+  }
+  recorderStats.recordedSamples += SAMPLES_IN_SNIPPET;
+  if (!hold)
+    recording = false;
+  return hold;
+}
+
+void stopRecording() {
+  if (!recording || streamingTake)
+    return;
+  recording = false;
+  takeEndPos = recordingRing->written();
+  recorderStats.recordedSamples = takeEndPos - takeStartPos;
+  stopRequested = true;
+}
+
+bool isRecording() {
+  return recording;
+}
+
+bool isUploading() {
+  return uploading;
+}
+
+void recordAudio(const int16_t* samples, size_t len) {
+  if (recording && (recordingRing != NULL))
+    recordingRing->write(samples, len);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Recording of arbitrarily long takes: the capture task writes into a large ring in PSRAM, a
+// background task uploads the take with chunked transfer encoding directly out of the ring while
+// it is recorded, in the codec of the device session (PCM or ADPCM). Without PSRAM the recorder
+// is off, the audio ring holds only about a second and a slow upload would lose most of the take.
+// A streamed take goes the other way to the backend: frames of one second with the probabilities
+// of the classifier over the stream connection (streaming.h). The classifier runs in loop()
+// (processStreaming), the frames are sent by the same background task.
+// Nothing here blocks the caller, connecting and sending happen in the background task.
+
+#define RECORDING_RING_SIZE (1 << 19)          // [samples] 1MB of PSRAM, 32s of upload backlog
+#define RECORDING_CHUNK 2048                   // [samples] per HTTP chunk
+#define STREAM_FRAME_QUEUE_LEN 4               // frames classified but not sent yet
+
+struct RecorderStats {
+  uint32_t recordedSamples = 0;                // samples of the current/last take
+  uint32_t uploadedSamples = 0;
+  uint32_t lostSamples = 0;                    // overwritten before they could be uploaded
+  uint32_t streamedFrames = 0;
+};
+extern RecorderStats recorderStats;
+
+void initRecorder();
+bool startRecording();                         // false if a take is still in progress
+bool startStreaming();
+void stopRecording();
+
+// streamed take: classifies and queues the next frame once a second of audio is in, the frame that
+// is completed with hold false ends the take. Returns false when the take has ended.
+bool processStreaming(bool hold);
+bool isRecording();
+bool isUploading();
+
+// called by the capture task for every block of samples
+void recordAudio(const int16_t* samples, size_t len);
@@ -0,0 +1,126 @@
+#include <Arduino.h>
+#include "resampler.h"
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+  while (b != 0) {
+    uint32_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// modified Bessel function of the first kind, order 0, for the Kaiser window
+static double besselI0(double x) {
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 32; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12)
+      break;
+  }
+  return sum;
+}
+
+// tap n of the windowed sinc, it runs at L * inRate
+float PolyphaseResampler::prototype(int n) const {
+  int length = L * taps;
+  double t = n - (length - 1) / 2.0;
+  double x = 2.0 * cutoff * t;
+  double sinc = (fabs(x) < 1e-9) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+  double r = 2.0 * t / (length - 1);
+  double window = besselI0(beta * sqrt(fmax(0.0, 1.0 - r * r))) / besselI0(beta);
+  return 2.0 * cutoff * sinc * window;
+}
+
+bool PolyphaseResampler::init(uint32_t inRate, uint32_t outRate) {
+  uint32_t d = gcd(inRate, outRate);
+  L = outRate / d;
+  M = inRate / d;
+  taps = RESAMPLER_MAX_TAPS;
+  while ((uint32_t)L * taps > RESAMPLER_MAX_COEFFS)
+    taps -= 8;
+  if (taps < 8)
+    return false;
+
+  // the prototype runs at L * inRate, the cutoff is the Nyquist frequency of the slower side,
+  // the transition band is centered on it
+  float nyquist = 0.5f * ((inRate < outRate) ? inRate : outRate);
+  float transition = 2.0f * (1.0f - RESAMPLER_PASSBAND) * nyquist;
+  float fs = (float)L * inRate;
+  this->inRate = inRate;
+  cutoff = nyquist / fs;
+
+  // Kaiser: what attenuation the length allows for this transition band
+  int length = L * taps;
+  attenuation = 8.0f + 2.285f * (length - 1) * 2.0f * M_PI * transition / fs;
+  beta = (attenuation > 50) ? 0.1102f * (attenuation - 8.7f)
+             : (attenuation > 21) ? 0.5842f * powf(attenuation - 21, 0.4f) + 0.07886f * (attenuation - 21) : 0;
+
+  // split into phases, each scaled to a DC gain of 1 (the interpolation gain L is folded in)
+  for (uint16_t p = 0; p < L; p++) {
+    float h[RESAMPLER_MAX_TAPS];
+    float sum = 0;
+    for (uint16_t k = 0; k < taps; k++) {
+      h[k] = prototype(p + k * L);
+      sum += h[k];
+    }
+    int32_t qsum = 0;
+    int16_t* c = &coeffs[p * taps];
+    for (uint16_t k = 0; k < taps; k++) {
+      c[taps - 1 - k] = (int16_t)lroundf(h[k] / sum * (1 << RESAMPLER_Q));
+      qsum += c[taps - 1 - k];
+    }
+    // rounding error into the largest tap
+    int16_t* peak = c;
+    for (uint16_t k = 1; k < taps; k++)
+      if (abs(c[k]) > abs(*peak))
+        peak = &c[k];
+    *peak += (1 << RESAMPLER_Q) - qsum;
+  }
+  reset();
+  return true;
+}
+
+void PolyphaseResampler::reset() {
+  memset(history, 0, sizeof(history));
+  pos = 0;
+  phase = 0;
+}
+
+size_t PolyphaseResampler::process(const int16_t* in, size_t inLen, int16_t* out) {
+  size_t outLen = 0;
+  for (size_t i = 0; i < inLen; i++) {
+    // append to both copies of the delay line
+    history[pos] = history[pos + taps] = in[i];
+    pos = (pos + 1 < taps) ? pos + 1 : 0;
+
+    // all outputs that fall onto this input sample, phase counts in 1/L input samples
+    while (phase < L) {
+      const int16_t* c = &coeffs[phase * taps];
+      const int16_t* x = &history[pos];
+      // |sum of the taps| of a phase stays below 2, int32 cannot overflow
+      int32_t acc = 1 << (RESAMPLER_Q - 1);
+      for (uint16_t k = 0; k < taps; k++)
+        acc += (int32_t)c[k] * x[k];
+      acc >>= RESAMPLER_Q;
+      out[outLen++] = (acc > 32767) ? 32767 : (acc < -32768) ? -32768 : acc;
+      phase += M;
+    }
+    phase -= L;
+  }
+  return outLen;
+}
+
+float PolyphaseResampler::response(float f) const {
+  int length = L * taps;
+  double fs = (double)L * inRate;
+  double re = 0, im = 0, sum = 0;
+  for (int n = 0; n < length; n++) {
+    double h = prototype(n);
+    re += h * cos(2.0 * M_PI * f * n / fs);
+    im -= h * sin(2.0 * M_PI * f * n / fs);
+    sum += h;
+  }
+  return sqrt(re * re + im * im) / sum;
+}
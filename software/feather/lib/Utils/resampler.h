@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Polyphase FIR resampler in fixed point, for microphones that do not run at SAMPLE_RATE.
+// The rate changes by L/M (48 kHz -> 16 kHz is 1/3, 44.1 kHz -> 16 kHz is 160/441). The prototype is a
+// Kaiser windowed sinc at the output Nyquist frequency, so whatever would alias folds into the
+// transition band above RESAMPLER_PASSBAND and not into the speech band. Only the L phases that
+// are actually used are computed, the coefficients are Q15 with a DC gain of exactly 1 per phase.
+// Samples are processed block-wise, the delay line and phase carry over from call to call.
+
+#define RESAMPLER_Q 15
+#define RESAMPLER_MAX_TAPS 96                   // [input samples] per phase
+#define RESAMPLER_MAX_COEFFS 8192               // L * taps, 44.1 kHz gets 160 phases of 48 taps
+#define RESAMPLER_PASSBAND 0.85f                // of the output Nyquist frequency, flat to 6.8 kHz at 16 kHz
+
+struct PolyphaseResampler {
+  uint16_t L = 1;                               // interpolation
+  uint16_t M = 1;                               // decimation
+  uint16_t taps = 0;                            // per phase
+  float attenuation = 0;                        // [dB] stop band of the prototype
+
+  // phase-major, the taps of a phase are reversed so they run along the delay line
+  int16_t coeffs[RESAMPLER_MAX_COEFFS];
+
+  // delay line kept twice, history[pos..pos+taps-1] is always the contiguous window, newest last
+  int16_t history[2 * RESAMPLER_MAX_TAPS];
+  uint16_t pos = 0;
+  uint32_t phase = 0;
+
+  // design the filter for inRate -> outRate [Hz], false if the ratio needs more coefficients than there are
+  bool init(uint32_t inRate, uint32_t outRate);
+
+  // zero the delay line
+  void reset();
+
+  // number of output samples inLen input samples yield at most
+  size_t maxOutput(size_t inLen) const { return ((size_t)inLen * L) / M + 1; }
+
+  // resample inLen samples into out (room for maxOutput(inLen)), returns the number of output samples
+  size_t process(const int16_t* in, size_t inLen, int16_t* out);
+
+  // gain at frequency f [Hz] of the float prototype the coefficients were quantized from, the reference for tests
+  float response(float f) const;
+
+  private:
+    float inRate = 0;
+    float cutoff = 0;                           // relative to L * inRate
+    float beta = 0;                             // Kaiser window
+    float prototype(int n) const;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+
+// Single-producer/single-consumer ring buffer used as the audio history.
+// The producer (I2S drain) only ever appends, the oldest samples are overwritten
+// implicitly. Consumers keep their own read position (a sample counter), so nothing
+// is shifted and a 1s window is only linearised when a classification is due.
+// N must be a power of two, positions are free running 32-bit counters.
+template <typename T, size_t N>
+class RingBuffer {
+  static_assert((N & (N - 1)) == 0, "RingBuffer size must be a power of two");
+
+  public:
+    RingBuffer() : head(0) {};
+
+    // number of elements the buffer can hold
+    static constexpr size_t capacity() { return N; }
+
+    // total number of elements ever written (free running position of the producer)
+    uint32_t written() const { return head.load(std::memory_order_acquire); }
+
+    // producer: append len elements, overwriting the oldest ones
+    void write(const T* src, size_t len) {
+      uint32_t pos = head.load(std::memory_order_relaxed);
+      if (len > N) {
+        // only the last N elements survive anyway
+        src += len - N;
+        pos += len - N;
+        len = N;
+      }
+      size_t idx = pos & (N - 1);
+      size_t first = (idx + len <= N) ? len : N - idx;
+      memcpy(&buffer[idx], src, first * sizeof(T));
+      if (first < len)
+        memcpy(&buffer[0], src + first, (len - first) * sizeof(T));
+      head.store(pos + len, std::memory_order_release);
+    }
+
+    // producer: direct access to the contiguous free region at the write position,
+    // used to let a driver write without intermediate copy. Returns the number of elements
+    // that can be written in one go (up to max), commit() makes them visible.
+    T* writePtr(size_t max, size_t &len) {
+      size_t idx = head.load(std::memory_order_relaxed) & (N - 1);
+      len = (N - idx < max) ? N - idx : max;
+      return &buffer[idx];
+    }
+    void commit(size_t len) {
+      head.store(head.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+    // consumer: true if the elements starting at position pos have not been overwritten yet
+    bool isValid(uint32_t pos, size_t len) const {
+      uint32_t h = written();
+      return (h - pos <= N) && (h - pos >= len);
+    }
+
+    // consumer: copy len elements starting at position pos into dst (wrap-aware).
+    // Returns false if the data has been overwritten already or is not yet written.
+    bool read(uint32_t pos, T* dst, size_t len) const {
+      if (!isValid(pos, len))
+        return false;
+      size_t idx = pos & (N - 1);
+      size_t first = (idx + len <= N) ? len : N - idx;
+      memcpy(dst, &buffer[idx], first * sizeof(T));
+      if (first < len)
+        memcpy(dst + first, &buffer[0], (len - first) * sizeof(T));
+
+      // the producer might have lapped us while copying
+      return isValid(pos, len);
+    }
+
+    // consumer: copy the most recent len elements into dst
+    bool readLatest(T* dst, size_t len) const {
+      return read(written() - len, dst, len);
+    }
+
+    // consumer: zero-copy view of len elements at pos, split into at most two contiguous parts
+    void view(uint32_t pos, size_t len, const T* &part1, size_t &len1, const T* &part2, size_t &len2) const {
+      size_t idx = pos & (N - 1);
+      len1 = (idx + len <= N) ? len : N - idx;
+      part1 = &buffer[idx];
+      len2 = len - len1;
+      part2 = &buffer[0];
+    }
+
+  private:
+    T buffer[N];
+    std::atomic<uint32_t> head;
+};
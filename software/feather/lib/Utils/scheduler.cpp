@@ -0,0 +1,141 @@
+#include <Arduino.h>
+#include "scheduler.h"
+#include "constants.h"
+#include "heapstats.h"
+
+static ScheduledTask tasks[SCHEDULER_MAX_TASKS];
+static uint32_t statsSince_us = 0;
+static uint32_t idlePasses = 0;
+static uint32_t allocationsSince = 0;
+
+static int addTask(const char* name, ScheduledFunction function, uint32_t period_ms, uint32_t delay_ms, uint32_t deadline_ms, TaskPriority priority) {
+  for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+    if (tasks[i].active)
+      continue;
+    tasks[i] = ScheduledTask();
+    tasks[i].name = name;
+    tasks[i].function = function;
+    tasks[i].period_us = period_ms * 1000;
+    tasks[i].deadline_us = deadline_ms * 1000;
+    tasks[i].due_us = micros() + delay_ms * 1000;
+    tasks[i].priority = priority;
+    tasks[i].active = true;
+    return i;
+  }
+  println("scheduler: no slot for %s", name);
+  return -1;
+}
+
+int addPeriodicTask(const char* name, ScheduledFunction function, uint32_t period_ms, uint32_t deadline_ms, TaskPriority priority) {
+  return addTask(name, function, period_ms, 0, deadline_ms, priority);
+}
+
+int addOneShotTask(const char* name, ScheduledFunction function, uint32_t delay_ms, uint32_t deadline_ms, TaskPriority priority) {
+  return addTask(name, function, 0, delay_ms, deadline_ms, priority);
+}
+
+void cancelTask(int slot) {
+  if ((slot >= 0) && (slot < SCHEDULER_MAX_TASKS))
+    tasks[slot].active = false;
+}
+
+// signed distance, positive if a is after b (wrap-around safe)
+static inline int32_t after(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b);
+}
+
+// true if running the candidate now would push a higher priority task past its deadline
+static bool wouldDelayHigher(const ScheduledTask& candidate, uint32_t now) {
+  if (after(now, candidate.due_us + candidate.deadline_us) >= 0)
+    return false;                           // already late, run it anyway
+  uint32_t end = now + candidate.estimate_us;
+  for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+    const ScheduledTask& t = tasks[i];
+    if (t.active && (t.priority < candidate.priority) && (after(end, t.due_us + t.deadline_us) > 0))
+      return true;
+  }
+  return false;
+}
+
+bool runScheduler() {
+  uint32_t now = micros();
+
+  // most urgent due task: highest priority, then earliest deadline
+  int next = -1;
+  for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+    const ScheduledTask& t = tasks[i];
+    if (!t.active || (after(now, t.due_us) < 0))
+      continue;
+    if ((next < 0) || (t.priority < tasks[next].priority) ||
+        ((t.priority == tasks[next].priority) && (after(tasks[next].due_us + tasks[next].deadline_us, t.due_us + t.deadline_us) > 0)))
+      next = i;
+  }
+  if ((next < 0) || ((tasks[next].priority > PRIO_AUDIO) && wouldDelayHigher(tasks[next], now))) {
+    idlePasses++;
+    return false;
+  }
+
+  ScheduledTask& t = tasks[next];
+  uint32_t jitter = now - t.due_us;
+  if (jitter > t.maxJitter_us)
+    t.maxJitter_us = jitter;
+  if (jitter > t.deadline_us)
+    t.overruns++;
+
+  uint32_t allocationsBefore = loopHeapAllocations();
+  t.function();
+  t.allocations += loopHeapAllocations() - allocationsBefore;
+
+  uint32_t duration = micros() - now;
+  t.runs++;
+  t.totalDuration_us += duration;
+  if (duration > t.maxDuration_us)
+    t.maxDuration_us = duration;
+  if (duration > t.estimate_us)
+    t.estimate_us = duration;
+  else
+    t.estimate_us -= (t.estimate_us - duration) >> 3;
+
+  if (t.period_us == 0) {
+    t.active = false;
+  } else {
+    t.due_us += t.period_us;
+    // fell behind by more than a period: skip the missed runs instead of catching up in a burst
+    if (after(micros(), t.due_us) > (int32_t)t.period_us) {
+      t.due_us = micros() + t.period_us;
+      t.overruns++;
+    }
+  }
+  return true;
+}
+
+void resetSchedulerStats() {
+  for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+    tasks[i].runs = tasks[i].overruns = 0;
+    tasks[i].maxJitter_us = tasks[i].maxDuration_us = 0;
+    tasks[i].totalDuration_us = 0;
+    tasks[i].allocations = 0;
+  }
+  idlePasses = 0;
+  allocationsSince = loopHeapAllocations();
+  statsSince_us = micros();
+}
+
+void printSchedulerStats() {
+  float seconds = (micros() - statsSince_us) / 1e6f;
+  println("scheduler: %.1fs, %u idle passes", seconds, idlePasses);
+  uint32_t passes = idlePasses;
+  for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+    const ScheduledTask& t = tasks[i];
+    if (t.name == NULL)
+      continue;
+    passes += t.runs;
+    println("   %-12s prio %u period %5ums: %6u runs, %4u overruns, jitter max %6uus, duration mean %6uus max %6uus estimate %6uus",
+            t.name, t.priority, t.period_us / 1000, t.runs, t.overruns, t.maxJitter_us,
+            (t.runs > 0) ? (uint32_t)(t.totalDuration_us / t.runs) : 0, t.maxDuration_us, t.estimate_us);
+    if (heapTraceEnabled() && (t.allocations > 0))
+      println("   %-12s %u heap allocations, %.2f per run", t.name, t.allocations, (float)t.allocations / t.runs);
+  }
+  if (heapTraceEnabled())
+    println("   %.3f heap allocations per loop iteration", (passes > 0) ? (float)(loopHeapAllocations() - allocationsSince) / passes : 0.0f);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Cooperative scheduler for loop(): periodic and one-shot tasks with a priority and a deadline.
+// Every call of runScheduler() runs the most urgent due task, so audio work is checked between any two
+// housekeeping tasks. A lower priority task only starts if, judged by its recent run times, it ends
+// before the deadline of every higher priority task, unless it is already late itself. The estimate
+// follows a longer run at once and decays by 1/8 per shorter run, so a single long run does not keep
+// the task waiting for its deadline for good.
+// Tasks must not block, the table is static (no allocation). Exempt are the terminal commands a
+// developer types on purpose (benchmark 'p', test upload 'w', model switch 'm'), they block for up to
+// seconds and make the audio task late, which shows up as its overruns.
+
+#define SCHEDULER_MAX_TASKS 12
+
+typedef void (*ScheduledFunction)();
+
+enum TaskPriority : uint8_t {
+  PRIO_AUDIO = 0,                           // has to run on time (drain, classify, turn the page)
+  PRIO_CONTROL = 1,                         // user input, buttons
+  PRIO_HOUSEKEEPING = 2                     // LED, battery, heartbeat, fills the slack
+};
+
+struct ScheduledTask {
+  const char* name = NULL;
+  ScheduledFunction function = NULL;
+  uint32_t period_us = 0;                   // 0 for a one-shot task
+  uint32_t deadline_us = 0;                 // allowed start delay after it became due
+  uint32_t due_us = 0;
+  uint32_t estimate_us = 0;                 // expected duration for the admission, decaying peak
+  TaskPriority priority = PRIO_HOUSEKEEPING;
+  bool active = false;
+
+  // statistics
+  uint32_t runs = 0;
+  uint32_t overruns = 0;                    // started after the deadline (or periods skipped)
+  uint32_t maxJitter_us = 0;                // start delay after due
+  uint32_t maxDuration_us = 0;
+  uint64_t totalDuration_us = 0;
+  uint32_t allocations = 0;                 // heap allocations during its runs (debug build with HEAP_TRACE)
+};
+
+// returns the task slot, -1 if the table is full
+int addPeriodicTask(const char* name, ScheduledFunction function, uint32_t period_ms, uint32_t deadline_ms, TaskPriority priority);
+int addOneShotTask(const char* name, ScheduledFunction function, uint32_t delay_ms, uint32_t deadline_ms, TaskPriority priority);
+void cancelTask(int slot);
+
+// run the most urgent due task, false if nothing was due
+bool runScheduler();
+void resetSchedulerStats();
+void printSchedulerStats();
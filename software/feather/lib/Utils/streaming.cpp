@@ -0,0 +1,108 @@
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include "streaming.h"
+#include "constants.h"
+#include "network.h"
+
+static WiFiClient streamClient;
+static uint32_t streamSeq = 0;
+static uint32_t lastConnectAttempt = 0;
+static const uint32_t reconnectDelay_ms = 1000;         // do not hammer the server if it is down
+
+// audio frames come from loop(), heartbeats from the network task
+static SemaphoreHandle_t streamMutex() {
+  static StaticSemaphore_t buffer;
+  static SemaphoreHandle_t mutex = xSemaphoreCreateMutexStatic(&buffer);
+  return mutex;
+}
+
+// connect if not connected yet, the connection is kept open for all following frames
+bool openAudioStream() {
+  if (streamClient.connected())
+    return true;
+
+  if ((WiFi.status() != WL_CONNECTED) || (backendHost() == ""))
+    return false;
+
+  uint32_t now = millis();
+  if ((lastConnectAttempt != 0) && (now - lastConnectAttempt < reconnectDelay_ms))
+    return false;
+  lastConnectAttempt = now;
+
+  String host = backendHost();
+  if (!streamClient.connect(host.c_str(), STREAM_PORT)) {
+    println("stream connect to %s:%i failed", host.c_str(), STREAM_PORT);
+    return false;
+  }
+  streamClient.setNoDelay(true);
+  streamSeq = 0;
+  println("stream connected to %s:%i", host.c_str(), STREAM_PORT);
+  return true;
+}
+
+void closeAudioStream() {
+  xSemaphoreTake(streamMutex(), portMAX_DELAY);
+  streamClient.stop();
+  xSemaphoreGive(streamMutex());
+}
+
+static bool writeAll(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    size_t written = streamClient.write(data, len);
+    if (written == 0)
+      return false;
+    data += written;
+    len -= written;
+  }
+  return true;
+}
+
+bool sendStreamFrame(uint8_t type, uint8_t format, uint8_t flags, const uint8_t* payload, size_t payloadBytes, uint16_t samples,
+                     const float* confidence, uint8_t labelCount) {
+  xSemaphoreTake(streamMutex(), portMAX_DELAY);
+  if (!openAudioStream()) {
+    xSemaphoreGive(streamMutex());
+    return false;
+  }
+
+  StreamFrameHeader header;
+  header.magic[0] = STREAM_MAGIC_0;
+  header.magic[1] = STREAM_MAGIC_1;
+  header.version = STREAM_VERSION;
+  header.type = type;
+  header.device_id = ESP.getEfuseMac();
+  header.seq = streamSeq++;
+  header.sample_rate = SAMPLE_RATE;
+  header.format = format;
+  header.flags = flags;
+  header.label_count = (confidence != NULL) ? labelCount : 0;
+  header.reserved = 0;
+  header.samples = samples;
+  header.payload_bytes = payloadBytes;
+
+  bool ok = writeAll((const uint8_t*)&header, sizeof(header)) &&
+            writeAll((const uint8_t*)confidence, header.label_count * sizeof(float)) &&
+            writeAll(payload, payloadBytes);
+  if (!ok) {
+    println("stream write failed, reconnecting");
+    streamClient.stop();
+  }
+  xSemaphoreGive(streamMutex());
+  return ok;
+}
+
+// frames are sent in the codec of the device session, the ADPCM state runs on through a take
+static AdpcmEncoder streamEncoder;
+static uint8_t encodedFrame[ADPCM_BLOCK_BYTES(SAMPLES_IN_SNIPPET)];
+
+bool sendAudioFrame(const int16_t* samples, size_t count, uint8_t flags, const float* confidence, uint8_t labelCount) {
+  if ((audioCodec == CODEC_ADPCM) && (count <= SAMPLES_IN_SNIPPET)) {
+    if (flags & STREAM_FLAG_START)
+      streamEncoder.reset();
+    size_t bytes = streamEncoder.encodeBlock(samples, count, encodedFrame);
+    return sendStreamFrame(STREAM_FRAME_AUDIO, STREAM_FORMAT_IMA_ADPCM, flags, encodedFrame, bytes, count, confidence, labelCount);
+  }
+  return sendStreamFrame(STREAM_FRAME_AUDIO, STREAM_FORMAT_PCM16, flags, (const uint8_t*)samples, count * BYTES_PER_SAMPLE, count,
+                         confidence, labelCount);
+}
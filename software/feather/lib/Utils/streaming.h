@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Binary streaming channel to the backend: one persistent TCP connection,
+// every frame is a fixed header followed by the confidences and the audio payload.
+
+#define STREAM_PORT 8001
+#define STREAM_MAGIC_0 'T'
+#define STREAM_MAGIC_1 'T'
+#define STREAM_VERSION 1
+
+// frame types
+#define STREAM_FRAME_AUDIO 1
+#define STREAM_FRAME_HEARTBEAT 2         // payload is a HeartbeatFrame, see heartbeat.h
+
+// sample formats of the payload
+#define STREAM_FORMAT_PCM16 0            // signed 16-bit little endian
+#define STREAM_FORMAT_IMA_ADPCM 1        // one ADPCM block per frame, see adpcm.h
+
+// frame flags
+#define STREAM_FLAG_START 0x01           // first frame of a take, server opens a new file
+#define STREAM_FLAG_END   0x02           // last frame of a take, server closes the file
+
+// all fields little endian, followed by label_count floats and payload_bytes of audio
+struct __attribute__((packed)) StreamFrameHeader {
+  uint8_t  magic[2];
+  uint8_t  version;
+  uint8_t  type;
+  uint64_t device_id;                    // efuse MAC
+  uint32_t seq;                          // sequence number, counts all frames of this connection
+  uint16_t sample_rate;                  // [Hz]
+  uint8_t  format;
+  uint8_t  flags;
+  uint8_t  label_count;
+  uint8_t  reserved;
+  uint16_t samples;                      // number of samples in the payload
+  uint32_t payload_bytes;
+};
+
+bool openAudioStream();
+void closeAudioStream();
+bool sendStreamFrame(uint8_t type, uint8_t format, uint8_t flags, const uint8_t* payload, size_t payloadBytes, uint16_t samples,
+                     const float* confidence = NULL, uint8_t labelCount = 0);
+bool sendAudioFrame(const int16_t* samples, size_t count, uint8_t flags, const float* confidence = NULL, uint8_t labelCount = 0);
@@ -4,6 +4,16 @@
 #include "EEPROMStorage.h"
 #include "network.h"
 #include "soundtools.h"
+#include "benchmark.h"
+#include "pipeline.h"
+#include "cascade.h"
+#include "inference.h"
+#include "boot.h"
+#include "log.h"
+#include "scheduler.h"
+#include "bleturn.h"
+#include "heapstats.h"
+#include "flightrecorder.h"
 
 // Flags and buffers for command processing
 bool commandPending = false;                                // true if a command is in progress
@@ -13,10 +23,8 @@ uint32_t commandLastChar_us = 0;                            // timestamp of last
 // Add a character to incoming command
 void addCmd(char ch, bool out = true) {
   if ((ch != 10) && (ch != 13)) {
-    if (out) {
+    if (out)
       Serial.print(ch);
-      Serial.flush();
-    }
 
     command += ch;
   }
@@ -38,7 +46,14 @@ void printHelp() {
   println("   n       - start captive WiFi Portal");
   println("   s       - set owner");
   println("   w       - send sine wave audio snippet");
-  println("   d       - send device information");
+  println("   d       - boot, WiFi, log, scheduler, BLE, heap and flight recorder statistics, send a heartbeat");
+  println("   a       - audio capture statistics");
+  println("   p       - benchmark of all audio stages");
+  println("   c       - toggle the detector cascade, print duty cycle");
+  println("   g       - toggle the automatic gain control, print its state");
+  println("   m<n>    - switch to the model in partition model<n>");
+  println("   u       - update model and firmware from the backend");
+  println("   l       - toggle debug output");
   println("   h       - help");
 }
 
@@ -70,17 +85,74 @@ void executeManualCommand() {
         if (command == "") startCaptivePortal(); else addCmd(inputChar);
         break;
       case 'd':
-        if (command == "") sendDevice(); else addCmd(inputChar);
+        if (command == "") {
+          printBootStats();
+          printNetworkStats();
+          printLogStats();
+          printSchedulerStats();
+          printBleStats();
+          printHeapStats();
+          printFlightRecorderStats();
+          resetSchedulerStats();
+          requestHeartbeat();                 // sent by the network task
+        } else addCmd(inputChar);
+        break;
+      case 'a':
+        if (command == "") {
+          printAudioCaptureStats();
+          printAgcStats(audioGain);
+        } else addCmd(inputChar);
+        break;
+      case 'p':
+        if (command == "") runBenchmark(100); else addCmd(inputChar);
+        break;
+      case 'c':
+        if (command == "") {
+          printPipelineStats();
+          cascadeConfig.enabled = !cascadeConfig.enabled;
+          initPipeline();
+          resetPipelineStats();
+          println("cascade %s", cascadeConfig.enabled ? "on" : "off");
+        } else addCmd(inputChar);
+        break;
+      case 'g':
+        if (command == "") {
+          printAgcStats(audioGain);
+          agcConfig.enabled = !agcConfig.enabled;
+          initPipeline();
+          println("AGC %s", agcConfig.enabled ? "on" : "off");
+        } else addCmd(inputChar);
         break;
       case 'h':
         if (command == "") printHelp(); else addCmd(inputChar);
         break;
+      case 'l':
+        if (command == "") {
+          config.debugLevel = (config.debugLevel + 1) % 2;
+          persConfig.writeConfig();
+          logLevel = LOG_INFO + config.debugLevel;
+          printLogStats();
+        } else addCmd(inputChar);
+        break;
+      case 'u':
+        if (command == "") {
+          requestUpdate();                    // the network task downloads, the model is switched by loop()
+        } else addCmd(inputChar);
+        break;
       case 'w':
         if (command == "") {
-          int16_t* buffer = new int16_t [SAMPLE_RATE] ; 
-          generateSineWave(buffer,SAMPLE_RATE);
-          sendAudioSnippet(buffer, SAMPLE_RATE); 
-          delete buffer;
+          // 1s test tone, generated and uploaded in small blocks
+          if (beginAudioUpload()) {
+            int16_t buffer[256];
+            bool ok = true;
+            for (uint32_t pos = 0; ok && (pos < SAMPLE_RATE); pos += 256) {
+              size_t n = min((uint32_t)256, SAMPLE_RATE - pos);
+              generateSineWave(buffer, n, 440.0, 0.8, pos);
+              ok = writeUploadAudio(buffer, n);
+            }
+            if (ok)
+              endAudioUpload();
+          }
         }
           else addCmd(inputChar);
         break;
@@ -92,6 +164,14 @@ void executeManualCommand() {
         break;
       case 10:  // LF
       case 13:  // CR
+        if (command.startsWith("m")) {
+          Serial.println();
+          String partition = "model" + command.substring(1);
+          if (selectModelPartition(partition.c_str()))
+            initPipeline();
+          emptyCmd();
+          break;
+        }
         if (command.startsWith("s")) {
           Serial.println();
           setOwner(command.substring(1));
@@ -1,3 +1,4 @@
 #pragma once
 
-void  executeManualCommand();
\ No newline at end of file
+// runs as a scheduler task. The commands 'p', 'w' and 'm' block for up to seconds on purpose, see scheduler.h
+void  executeManualCommand();
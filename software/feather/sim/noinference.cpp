@@ -0,0 +1,61 @@
+#include <Arduino.h>
+#include "inference.h"
+#include "energy.h"
+#include "constants.h"
+
+// Stand-in for inference.cpp when the simulation is built without the Edge Impulse SDK.
+// The classifier never predicts anything, all other stages run as on the device.
+
+#define NO_LABELS 1
+#define SLICE_SIZE (SAMPLE_RATE/10)
+
+InferenceTiming lastInferenceTiming = { 0, 0 };
+ArenaStats inferenceArena;
+
+uint16_t silence_label_no = 0;
+uint16_t weiter_label_no  = NO_LABELS;
+uint16_t next_label_no    = NO_LABELS;
+uint16_t zurueck_label_no = NO_LABELS;
+uint16_t back_label_no    = NO_LABELS;
+
+float computeRMS(const int16_t* samples, size_t len) {
+  if (len == 0)
+    return 0;
+  return sqrtf((float)sumOfSquares(samples, len) / (float)len) / 32768.0f;
+}
+
+void runInference(int16_t /* buffer */[], size_t /* samples */, float confidence[], int &pred_no) {
+  confidence[0] = 0;
+  pred_no = -1;
+}
+
+void runInferenceSlice(int16_t /* slice */[], float confidence[], int &pred_no) {
+  confidence[0] = 0;
+  pred_no = -1;
+}
+
+void resetContinuousInference() {
+}
+
+size_t get_slice_size() {
+  return SLICE_SIZE;
+}
+
+uint8_t get_no_of_labels() {
+  return NO_LABELS;
+}
+
+void setupInference() {
+}
+
+bool selectModelPartition(const char* /* partitionLabel */) {
+  return false;
+}
+
+void printInferenceInfo() {
+  println("no model built in");
+}
+
+const char* getLabelName(uint8_t /* no */) {
+  return "silence";
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+// Minimal Arduino API to build the audio pipeline of lib/Utils on a host.
+// millis() follows the simulated audio clock (set by the simulation), so all
+// time based logic behaves as on the device, micros() is the host's wall clock
+// and used to time the stages.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+#define HIGH 0x1
+#define LOW  0x0
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void setSimulatedMillis(uint32_t ms);
+
+class String : public std::string {
+  public:
+    String() {}
+    String(const char* s) : std::string(s ? s : "") {}
+    String(const std::string &s) : std::string(s) {}
+    String(int v) : std::string(std::to_string(v)) {}
+    String(unsigned int v) : std::string(std::to_string(v)) {}
+    String(long v) : std::string(std::to_string(v)) {}
+    String(unsigned long v) : std::string(std::to_string(v)) {}
+    String(float v) : std::string(std::to_string(v)) {}
+    String(double v) : std::string(std::to_string(v)) {}
+
+    bool startsWith(const String &prefix) const { return compare(0, prefix.size(), prefix) == 0; }
+    String substring(size_t from) const { return (from < size()) ? String(substr(from)) : String(); }
+    String substring(size_t from, size_t to) const { return (from < size()) ? String(substr(from, to - from)) : String(); }
+    void trim() {
+      size_t a = find_first_not_of(" \t\r\n");
+      size_t b = find_last_not_of(" \t\r\n");
+      *this = (a == npos) ? String() : String(substr(a, b - a + 1));
+    }
+};
+
+class HardwareSerial {
+  public:
+    void begin(unsigned long) {}
+    int available() { return 0; }
+    int read() { return -1; }
+    void flush() { fflush(stdout); }
+    size_t print(const char* s) { return fputs(s, stdout); }
+    size_t print(const String &s) { return print(s.c_str()); }
+    size_t print(char c) { return fputc(c, stdout) != EOF; }
+    size_t println(const char* s = "") { return printf("%s\n", s); }
+    size_t println(const String &s) { return println(s.c_str()); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    operator bool() const { return true; }
+};
+extern HardwareSerial Serial;
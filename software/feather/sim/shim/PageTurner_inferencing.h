@@ -0,0 +1,7 @@
+#pragma once
+
+// Host counterpart of the Arduino library header, resolved against the Edge Impulse C++ SDK (-DEI_SDK_DIR)
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+#include "edge-impulse-sdk/dsp/numpy.hpp"
+
+using namespace ei;
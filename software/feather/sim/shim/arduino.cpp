@@ -0,0 +1,32 @@
+#include <chrono>
+#include <thread>
+#include "Arduino.h"
+
+HardwareSerial Serial;
+
+static uint32_t simulatedMillis = 0;
+static const auto startTime = std::chrono::steady_clock::now();
+
+uint32_t millis() {
+  return simulatedMillis;
+}
+
+void setSimulatedMillis(uint32_t ms) {
+  simulatedMillis = ms;
+}
+
+uint32_t micros() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(uint32_t ms) {
+  simulatedMillis += ms;
+}
+
+size_t HardwareSerial::printf(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int n = vprintf(format, args);
+  va_end(args);
+  return (n > 0) ? n : 0;
+}
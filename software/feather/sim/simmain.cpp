@@ -0,0 +1,791 @@
+// Host simulation of the page turner pipeline.
+// Feeds WAV files (16kHz, 16-bit mono, as in dataset/ and trainingdataset/) through the
+// production pipeline of lib/Utils and reports per-stage timing, decisions and detection latency.
+//
+//   pagesim [options] [-v] [--record-trace <out.csv>] <file.wav | directory> ...
+//   pagesim [options] --trace <trace.csv>    replay recorded probabilities through the decision engine only
+//   pagesim --bench <iterations>             same stage benchmark as the serial command 'p' on the device
+//   pagesim --resampler                      frequency response of the microphone resampler against its float design
+//   pagesim --energy                         integer silence gate against a double reference, cost against the float RMS it replaced
+//   pagesim --ringbuffer                     wrap-around, overrun and split views of the audio ring, throughput against a moving window
+//   pagesim --compare-levels <file.wav | directory> ...   all files at several input levels, without and with the AGC
+//
+// options of the decision engine: --ema <alpha> | --window <n>, --on <threshold>, --off <threshold>, --refractory <ms>
+// options of the detector cascade: --no-cascade, --compare-cascade (runs all files without and with the cascade
+// and reports the cpu duty cycle of both)
+// options of the input: --level <dB> scales the files, --no-agc switches the automatic gain control off
+//
+// The expected decision is derived from the folder (or file name prefix) of each file:
+// weiter -> page down, zurück -> page up, everything else must not turn a page (as mapped by initPipeline()).
+//
+// Probability traces are CSV files with a header "time_ms,expected,<label>,..." and one line per inference,
+// expected is none/down/up and marks the rows where a command is spoken. --record-trace writes them
+// while simulating WAV files.
+
+#include <Arduino.h>
+#include <filesystem>
+#include <algorithm>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+#include "constants.h"
+#include "soundtools.h"
+#include "inference.h"
+#include "pipeline.h"
+#include "benchmark.h"
+#include "cascade.h"
+#include "resampler.h"
+#include "ringbuffer.h"
+#include "energy.h"
+
+namespace fs = std::filesystem;
+
+static const size_t chunkSize = I2S_DMA_BUF_LEN;        // samples per I2S DMA buffer, as delivered on the device
+static const uint32_t paddingMs = 1000;                 // silence before and after each file
+
+struct FileResult {
+  std::string path;
+  PageTurnType expected;
+  std::vector<std::pair<PageTurnType, uint32_t>> turns;  // decision and time after file start [ms]
+};
+
+// read a 16-bit mono PCM WAV file with SAMPLE_RATE
+static bool readWav(const std::string &path, std::vector<int16_t> &samples) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+
+  char riff[12];
+  bool ok = (fread(riff, 1, 12, f) == 12) && (memcmp(riff, "RIFF", 4) == 0) && (memcmp(riff + 8, "WAVE", 4) == 0);
+  uint16_t format = 0, channels = 0, bits = 0;
+  uint32_t rate = 0;
+  while (ok) {
+    char id[4];
+    uint32_t size;
+    if ((fread(id, 1, 4, f) != 4) || (fread(&size, 4, 1, f) != 1)) {
+      ok = false;
+      break;
+    }
+    if (memcmp(id, "fmt ", 4) == 0) {
+      uint8_t fmt[16];
+      ok = (size >= 16) && (fread(fmt, 1, 16, f) == 16);
+      memcpy(&format, fmt, 2);
+      memcpy(&channels, fmt + 2, 2);
+      memcpy(&rate, fmt + 4, 4);
+      memcpy(&bits, fmt + 14, 2);
+      fseek(f, size - 16 + (size & 1), SEEK_CUR);
+    } else if (memcmp(id, "data", 4) == 0) {
+      ok = (format == 1) && (channels == 1) && (bits == 16) && (rate == SAMPLE_RATE);
+      if (ok) {
+        samples.resize(size / sizeof(int16_t));
+        samples.resize(fread(samples.data(), sizeof(int16_t), samples.size(), f));
+      }
+      break;
+    } else {
+      fseek(f, size + (size & 1), SEEK_CUR);
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+// expected page turn derived from the folder or the file name prefix
+static PageTurnType expectedTurn(const fs::path &path) {
+  std::string names[] = { path.parent_path().filename().string(), path.stem().string() };
+  for (std::string name : names) {
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    name = name.substr(0, name.find_first_of("_."));
+    if (name == "weiter")
+      return TURN_PAGE_DOWN;
+    if (name == "zurück")
+      return TURN_PAGE_UP;
+  }
+  return TURN_NONE;
+}
+
+static const char* turnName(PageTurnType turn) {
+  switch (turn) {
+    case TURN_PAGE_DOWN: return "page down";
+    case TURN_PAGE_UP:   return "page up";
+    default:             return "none";
+  }
+}
+
+// short names used in the expected column of traces
+static const char* traceName(PageTurnType turn) {
+  switch (turn) {
+    case TURN_PAGE_DOWN: return "down";
+    case TURN_PAGE_UP:   return "up";
+    default:             return "none";
+  }
+}
+
+static PageTurnType traceTurn(const std::string &name) {
+  if (name == "down")
+    return TURN_PAGE_DOWN;
+  if (name == "up")
+    return TURN_PAGE_UP;
+  return TURN_NONE;
+}
+
+// trace recording of the probability vectors of the simulated files
+static FILE* traceOut = NULL;
+static PageTurnType traceExpected = TURN_NONE;
+
+static void recordSlice(const float* confidence, PageTurnType /* turn */) {
+  fprintf(traceOut, "%u,%s", millis(), traceName(traceExpected));
+  for (uint8_t i = 0;i<get_no_of_labels();i++)
+    fprintf(traceOut, ",%.4f", confidence[i]);
+  fprintf(traceOut, "\n");
+}
+
+static StageTime drainTime;
+static StageTime filterTime;
+static uint64_t simulatedSamples = 0;
+static float inputGain = 1.0;                           // --level
+static std::vector<float> activeLevels;                 // [dBFS] RMS of the last second times the AGC gain, when not silent
+
+// feed samples in I2S sized chunks through the pipeline, the simulated clock follows the audio
+static void feed(const int16_t* samples, size_t len, uint32_t fileStartMs, FileResult &result) {
+  static int16_t scaled[chunkSize];
+  static int16_t filtered[chunkSize];
+  for (size_t pos = 0; pos < len; pos += chunkSize) {
+    size_t n = std::min(chunkSize, len - pos);
+    for (size_t i = 0; i < n; i++)
+      scaled[i] = (int16_t)std::max(-32768.0f, std::min(32767.0f, samples[pos + i] * inputGain));
+
+    uint32_t t0 = micros();
+    audioRing.write(scaled, n);
+    uint32_t t1 = micros();
+    memcpy(filtered, scaled, n * sizeof(int16_t));
+    filterAudio(filtered, n);
+    uint32_t t2 = micros();
+    drainTime.add(t1 - t0);
+    filterTime.add(t2 - t1);
+
+    simulatedSamples += n;
+    setSimulatedMillis((uint32_t)(simulatedSamples * 1000 / SAMPLE_RATE));
+
+    uint32_t slices = cascadeStats.slices;
+    PageTurnType turn = processPendingSlices();
+    if (turn != TURN_NONE)
+      result.turns.push_back({ turn, millis() - fileStartMs });
+    if ((cascadeStats.slices != slices) && (lastDecision.rms * lastDecision.rms * 32768.0f * 32768.0f >= SILENCE_MEAN_SQUARE))
+      activeLevels.push_back(20 * log10f(lastDecision.rms * (agcConfig.enabled ? (float)audioGain.gain / AGC_UNITY : 1.0f)));
+  }
+}
+
+static void simulateFile(const fs::path &path, bool verbose, std::vector<FileResult> &results) {
+  std::vector<int16_t> samples;
+  if (!readWav(path.string(), samples)) {
+    println("skipping %s (not a 16kHz 16-bit mono WAV)", path.string().c_str());
+    return;
+  }
+
+  FileResult result;
+  result.path = path.string();
+  result.expected = expectedTurn(path);
+
+  // every file starts with a fresh pipeline, surrounded by silence
+  initPipeline();
+  std::vector<int16_t> silence(SAMPLE_RATE * paddingMs / 1000, 0);
+  feed(silence.data(), silence.size(), millis(), result);
+  result.turns.clear();
+  uint32_t fileStartMs = millis();
+  traceExpected = result.expected;
+  feed(samples.data(), samples.size(), fileStartMs, result);
+  traceExpected = TURN_NONE;
+  feed(silence.data(), silence.size(), fileStartMs, result);
+
+  if (verbose) {
+    println("%s: expected %s, %u decisions", result.path.c_str(), turnName(result.expected), (unsigned)result.turns.size());
+    for (auto &t : result.turns)
+      println("   %s after %ums", turnName(t.first), t.second);
+  }
+  results.push_back(result);
+}
+
+static void printStage(const char* name, const StageTime &t) {
+  println("   %-28s %8u calls %10.1f us mean %8u us max %10.1f ms total", name, t.count, t.mean_us(), t.max_us, t.total_us / 1000.0);
+}
+
+// Replay a probability trace through the decision engine and report time-to-detection and false triggers.
+// A command counts as detected if the right turn fires between its first row and graceMs after its last row.
+static int replayTrace(const char* path) {
+  const uint32_t graceMs = 1000;
+  std::ifstream in(path);
+  std::string line;
+  if (!in || !std::getline(in, line)) {
+    println("cannot read trace %s", path);
+    return 1;
+  }
+
+  // header: time_ms,expected,<labels>
+  std::vector<std::string> labels;
+  std::stringstream header(line);
+  std::string field;
+  for (int col = 0;std::getline(header, field, ',');col++)
+    if (col >= 2)
+      labels.push_back(field);
+  if (labels.empty() || (labels.size() > MAX_LABELS)) {
+    println("trace %s needs 1..%u label columns", path, MAX_LABELS);
+    return 1;
+  }
+
+  DecisionEngine engine;
+  engine.init(decisionConfig, labels.size());
+  for (size_t i = 0;i<labels.size();i++) {
+    PageTurnType turn = expectedTurn(fs::path(labels[i]));
+    if (turn != TURN_NONE)
+      engine.setCommand(i, turn);
+  }
+
+  struct Command { PageTurnType expected; uint32_t start, end; };
+  std::vector<Command> commands;
+  std::vector<std::pair<PageTurnType, uint32_t>> fired;
+  PageTurnType prevExpected = TURN_NONE;
+  uint32_t firstMs = 0, lastMs = 0;
+  size_t rows = 0;
+  float probabilities[MAX_LABELS];
+  while (std::getline(in, line)) {
+    std::stringstream row(line);
+    if (!std::getline(row, field, ','))
+      continue;
+    uint32_t time = strtoul(field.c_str(), NULL, 10);
+    std::getline(row, field, ',');
+    PageTurnType expected = traceTurn(field);
+    for (size_t i = 0;i<labels.size();i++)
+      probabilities[i] = std::getline(row, field, ',') ? strtof(field.c_str(), NULL) : 0.0;
+
+    if (rows++ == 0)
+      firstMs = time;
+    lastMs = time;
+    if ((expected != TURN_NONE) && (expected != prevExpected))
+      commands.push_back({ expected, time, time });
+    if (expected != TURN_NONE)
+      commands.back().end = time;
+    prevExpected = expected;
+
+    PageTurnType turn = engine.update(probabilities, time);
+    if (turn != TURN_NONE)
+      fired.push_back({ turn, time });
+  }
+
+  // match the turns against the commands
+  std::vector<uint32_t> latencies;
+  uint32_t wrong = 0, falseTriggers = 0;
+  std::vector<bool> matched(commands.size(), false);
+  for (auto &f : fired) {
+    bool inCommand = false;
+    for (size_t c = 0;c<commands.size();c++) {
+      if ((f.second < commands[c].start) || (f.second > commands[c].end + graceMs))
+        continue;
+      inCommand = true;
+      if (matched[c]) {
+        falseTriggers++;              // repeated turn for the same command
+      } else if (f.first == commands[c].expected) {
+        matched[c] = true;
+        latencies.push_back(f.second - commands[c].start);
+      } else {
+        wrong++;
+      }
+      break;
+    }
+    if (!inCommand)
+      falseTriggers++;
+  }
+
+  double hours = (lastMs - firstMs) / 3600000.0;
+  std::sort(latencies.begin(), latencies.end());
+  const DecisionConfig &cfg = engine.getConfig();
+  if (cfg.smoothing == SMOOTH_EMA)
+    println("decision engine: EMA alpha %.2f, on %.2f, off %.2f, refractory %u ms", cfg.emaAlpha, cfg.onThreshold, cfg.offThreshold, cfg.refractory_ms);
+  else
+    println("decision engine: window %u, on %.2f, off %.2f, refractory %u ms", cfg.window, cfg.onThreshold, cfg.offThreshold, cfg.refractory_ms);
+  println("trace %s: %u inferences, %.1f s, %u labels", path, (unsigned)rows, (lastMs - firstMs) / 1000.0, (unsigned)labels.size());
+  println("   commands %u, detected %u, wrong direction %u, missed %u",
+          (unsigned)commands.size(), (unsigned)latencies.size(), wrong, (unsigned)(commands.size() - latencies.size()));
+  if (!latencies.empty()) {
+    uint64_t sum = 0;
+    for (uint32_t l : latencies)
+      sum += l;
+    println("   time to detection: mean %.0f ms, median %u ms, max %u ms",
+            (double)sum / latencies.size(), latencies[latencies.size()/2], latencies.back());
+  }
+  println("   false triggers %u (%.1f per hour)", falseTriggers, (hours > 0) ? falseTriggers / hours : 0.0);
+  return 0;
+}
+
+struct SessionResult {
+  uint32_t commands, detected, wrong, falseTriggers;
+  float levelMedian, levelSpread;                       // [dB] of the non-silent windows, spread from 10th to 90th percentile
+  uint32_t activeWindows;
+};
+
+// simulate all files with a fresh pipeline and report decisions, timing and the cpu duty cycle
+static SessionResult simulateSession(const std::vector<fs::path> &files, bool verbose, bool report = true) {
+  simulatedSamples = 0;
+  activeLevels.clear();
+  uint32_t agcBlocks = audioGain.blocks, agcGated = audioGain.gatedBlocks, agcClipped = audioGain.clippedSamples;
+  drainTime = StageTime();
+  filterTime = StageTime();
+  resetPipelineStats();
+
+  std::vector<FileResult> results;
+  for (auto &f : files)
+    simulateFile(f, verbose, results);
+
+  // decisions and latency
+  uint32_t commands = 0, detected = 0, wrong = 0, falseTriggers = 0;
+  uint64_t latencySum = 0;
+  uint32_t latencyMax = 0;
+  for (auto &r : results) {
+    if (r.expected != TURN_NONE) {
+      commands++;
+      if (!r.turns.empty() && (r.turns[0].first == r.expected)) {
+        detected++;
+        latencySum += r.turns[0].second;
+        latencyMax = std::max(latencyMax, r.turns[0].second);
+      } else if (!r.turns.empty()) {
+        wrong++;
+      }
+      falseTriggers += (r.turns.size() > 1) ? r.turns.size() - 1 : 0;
+    } else {
+      falseTriggers += r.turns.size();
+    }
+  }
+
+  SessionResult session = { commands, detected, wrong, falseTriggers, 0, 0, (uint32_t)activeLevels.size() };
+  if (!activeLevels.empty()) {
+    std::sort(activeLevels.begin(), activeLevels.end());
+    session.levelMedian = activeLevels[activeLevels.size() / 2];
+    session.levelSpread = activeLevels[activeLevels.size() * 9 / 10] - activeLevels[activeLevels.size() / 10];
+  }
+  if (!report)
+    return session;
+
+  double audioSeconds = (double)simulatedSamples / SAMPLE_RATE;
+  println("simulated %u files, %.1f s of audio", (unsigned)results.size(), audioSeconds);
+  println("decisions:");
+  println("   commands %u, detected %u, wrong direction %u, missed %u, false triggers %u",
+          commands, detected, wrong, commands - detected - wrong, falseTriggers);
+  if (detected > 0)
+    println("   detection latency after start of file: mean %.0f ms, max %u ms", (double)latencySum / detected, latencyMax);
+
+  println("stage timing (host):");
+  printStage("I2S drain (ring write)", drainTime);
+  printStage("filterAudio", filterTime);
+  printStage("slice read", pipelineTiming.read);
+  printStage("AGC", pipelineTiming.level);
+  printStage("silence gate, cascade stage 1", pipelineTiming.gate);
+  printStage("inference", pipelineTiming.inference);
+  printStage("classifier refill", pipelineTiming.refill);
+  printStage("decision engine", pipelineTiming.decision);
+
+  uint64_t total_us = drainTime.total_us + filterTime.total_us + pipelineTiming.read.total_us + pipelineTiming.level.total_us +
+                      pipelineTiming.inference.total_us + pipelineTiming.refill.total_us + pipelineTiming.gate.total_us +
+                      pipelineTiming.decision.total_us;
+  if (audioSeconds > 0)
+    println("   real-time factor %.5f", total_us / 1e6 / audioSeconds);
+  println("cascade %s: %u slices, stage 1 triggers %u, stage 2 activations %u, classifier runs %u (%.1f%%), page turns %u",
+          cascadeConfig.enabled ? "on" : "off", cascadeStats.slices, cascadeStats.stage1Triggers, cascadeStats.stage2Activations,
+          cascadeStats.stage2Runs, (cascadeStats.slices > 0) ? 100.0 * cascadeStats.stage2Runs / cascadeStats.slices : 0.0,
+          cascadeStats.stage2Triggers);
+  uint64_t pipeline_us = pipelineTiming.read.total_us + pipelineTiming.level.total_us + pipelineTiming.gate.total_us +
+                         pipelineTiming.inference.total_us + pipelineTiming.refill.total_us + pipelineTiming.decision.total_us;
+  if (audioSeconds > 0)
+    println("   pipeline duty cycle %.3f%%", pipeline_us / 1e4 / audioSeconds);
+  println("AGC %s: %u blocks, %u below the gate, %u samples clipped, gain at the end %.2f",
+          agcConfig.enabled ? "on" : "off", audioGain.blocks - agcBlocks, audioGain.gatedBlocks - agcGated,
+          audioGain.clippedSamples - agcClipped, (float)audioGain.gain / AGC_UNITY);
+  println("   level of the non-silent windows: median %.1f dBFS, 10-90%% spread %.1f dB over %u windows",
+          session.levelMedian, session.levelSpread, session.activeWindows);
+  return session;
+}
+
+// Runs all files at several input levels, without and with the AGC. The silence gate measures before the
+// AGC, so the active windows must not change with it. With the AGC the level the classifier sees should
+// stay close to the target and the detections should not depend on the input level.
+static void compareLevels(const std::vector<fs::path> &files) {
+  const float levels[] = { -20, -10, 0, 6 };
+  println("%8s %5s %9s %9s %6s %7s %8s %10s %10s", "level", "AGC", "commands", "detected", "wrong", "false", "active", "median dB", "spread dB");
+  for (float level : levels) {
+    inputGain = powf(10.0f, level / 20.0f);
+    for (bool agc : { false, true }) {
+      agcConfig.enabled = agc;
+      SessionResult r = simulateSession(files, false, false);
+      println("%+7.0f %5s %9u %9u %6u %7u %8u %10.1f %10.1f", level, agc ? "on" : "off", r.commands, r.detected, r.wrong,
+              r.falseTriggers, r.activeWindows, r.levelMedian, r.levelSpread);
+    }
+  }
+  inputGain = 1.0;
+  agcConfig.enabled = true;
+}
+
+// Feeds sines through the fixed-point resampler in DMA sized blocks and compares the gain with the
+// float prototype: flat within 0.1 dB in the pass band, tones that would alias into the pass band
+// at least RESAMPLER_MIN_ALIAS_DB down. Returns the number of failed checks.
+#define RESAMPLER_MIN_ALIAS_DB 40.0
+static int testResampler() {
+  static PolyphaseResampler resampler;
+  const uint32_t rates[] = { 48000, 44100 };
+  const float amplitude = 16384;
+  int failures = 0;
+
+  for (uint32_t inRate : rates) {
+    if (!resampler.init(inRate, SAMPLE_RATE)) {
+      println("%u Hz: ratio not supported", inRate);
+      failures++;
+      continue;
+    }
+    println("%u Hz -> %u Hz: L %u, M %u, %u taps per phase, design attenuation %.1f dB",
+            inRate, SAMPLE_RATE, resampler.L, resampler.M, resampler.taps, resampler.attenuation);
+    println("   %8s %10s %10s %10s", "f [Hz]", "float [dB]", "fixed [dB]", "");
+
+    uint64_t cycles = 0, inputSamples = 0;
+    for (float f = 250; f < 0.5f * inRate; f += (f < 8000) ? 750 : 1500) {
+      resampler.reset();
+      std::vector<int16_t> in(inRate / 2), out(resampler.maxOutput(in.size()) + chunkSize);
+      for (size_t i = 0; i < in.size(); i++)
+        in[i] = (int16_t)lround(amplitude * sin(2.0 * M_PI * f * i / inRate));
+      size_t outLen = 0;
+      for (size_t i = 0; i < in.size(); i += chunkSize) {
+        uint32_t c = cycleCount();
+        outLen += resampler.process(&in[i], std::min(chunkSize, in.size() - i), &out[outLen]);
+        cycles += cycleCount() - c;
+      }
+      inputSamples += in.size();
+
+      // rms after the delay line has filled
+      double sum = 0;
+      size_t from = resampler.taps;
+      for (size_t i = from; i < outLen; i++)
+        sum += (double)out[i] * out[i];
+      double gain = sqrt(sum / (outLen - from)) / (amplitude / sqrt(2.0));
+      double fixedDb = 20 * log10(std::max(gain, 1e-6));
+      double floatDb = 20 * log10(std::max((double)resampler.response(f), 1e-6));
+
+      // above the output rate minus the pass band a tone would alias into the pass band
+      bool aliasing = (f >= SAMPLE_RATE - RESAMPLER_PASSBAND * SAMPLE_RATE / 2);
+      bool passband = (f <= RESAMPLER_PASSBAND * SAMPLE_RATE / 2);
+      bool ok = passband ? (fabs(fixedDb - floatDb) < 0.1) : !aliasing || (fixedDb < -RESAMPLER_MIN_ALIAS_DB);
+      if (!ok)
+        failures++;
+      println("   %8.0f %10.2f %10.2f %10s", f, floatDb, fixedDb, passband ? (ok ? "pass" : "FAIL pass band")
+                                                                       : aliasing ? (ok ? "alias" : "FAIL alias") : "transition");
+    }
+    println("   %.1f cycles per input sample (host)", (double)cycles / inputSamples);
+  }
+  println("resampler: %s", (failures == 0) ? "ok" : "failed");
+  return failures;
+}
+
+// the float RMS the silence gate used before sumOfSquares, for comparison only
+static float floatRMS(const int16_t* samples, size_t len) {
+  uint64_t acc = 0;
+  for (size_t i = 0; i < len; ++i) {
+    float y = samples[i] / 32768.0f;
+    acc += uint64_t(y * y * 1e9f);
+  }
+  return float(acc) / float(len) / 1e9f;
+}
+
+// Checks sumOfSquares on random, full scale and odd length buffers against a double sum, and the
+// sliding window of SlidingEnergy and its gate decision against the double mean square of the
+// last slices. Then the cost of the gate per slice: the float RMS over the whole second against
+// one slice into the sliding window. Returns the number of failed checks.
+static int testEnergy() {
+  static int16_t buffer[SAMPLES_IN_SNIPPET + 3];
+  int failures = 0;
+  srand(1);
+
+  // sumOfSquares: random levels, full scale of both signs, all lengths around the unrolling
+  for (int round = 0; round < 2000; round++) {
+    int16_t* samples = &buffer[round % 4];                         // unaligned starts as well
+    size_t len = (round < 64) ? round : rand() % (SAMPLES_IN_SNIPPET + 1);
+    int amplitude = 1 << (rand() % 16);
+    for (size_t i = 0; i < len; i++) {
+      if (round % 50 == 1)
+        samples[i] = -32768;
+      else if (round % 50 == 2)
+        samples[i] = 32767;
+      else
+        samples[i] = (int16_t)(rand() % (2 * amplitude) - amplitude);
+    }
+    double reference = 0;                                          // exact, the sum stays below 2^53
+    for (size_t i = 0; i < len; i++)
+      reference += (double)samples[i] * samples[i];
+    if ((double)sumOfSquares(samples, len) != reference) {
+      println("   sumOfSquares of %u samples: %llu, expected %.0f", len, sumOfSquares(samples, len), reference);
+      failures++;
+    }
+  }
+
+  // SlidingEnergy: the window of the last slices, while it fills and after it has filled,
+  // with a level that sweeps through the silence threshold
+  const uint16_t slices = 4;
+  const size_t slice = SAMPLES_IN_SNIPPET / slices;
+  SlidingEnergy energy;
+  energy.init(slices, slice);
+  std::vector<double> sliceSums;
+  uint32_t gateDiffers = 0;
+  for (int n = 0; n < 400; n++) {
+    int amplitude = 200 + ((n * 37) % 2400);
+    for (size_t i = 0; i < slice; i++)
+      buffer[i] = (int16_t)(rand() % (2 * amplitude) - amplitude);
+    energy.addSlice(buffer, slice);
+
+    double sum = 0;
+    for (size_t i = 0; i < slice; i++)
+      sum += (double)buffer[i] * buffer[i];
+    sliceSums.push_back(sum);
+    size_t filled = std::min(sliceSums.size(), (size_t)slices);
+    double window = 0;
+    for (size_t k = sliceSums.size() - filled; k < sliceSums.size(); k++)
+      window += sliceSums[k];
+    double meanSquare = window / (filled * slice);
+    if (fabs(energy.meanSquare() - meanSquare) >= 1.0) {
+      println("   sliding window after %d slices: %u, expected %.1f", n + 1, energy.meanSquare(), meanSquare);
+      failures++;
+    }
+    bool silent = meanSquare < 0.0006 * 32768.0 * 32768.0;
+    if ((energy.isBelow(SILENCE_MEAN_SQUARE) != silent) && (fabs(meanSquare - SILENCE_MEAN_SQUARE) >= 1.0))
+      gateDiffers++;
+  }
+  if (gateDiffers > 0) {
+    println("   silence gate differs from the reference in %u windows", gateDiffers);
+    failures++;
+  }
+
+  // cost per slice of a quarter second, the old gate went over the whole second each time
+  for (size_t i = 0; i < SAMPLES_IN_SNIPPET; i++)
+    buffer[i] = (int16_t)(rand() % 4000 - 2000);
+  const int iterations = 200;
+  uint64_t floatCycles = 0, slidingCycles = 0;
+  volatile float sink = 0;
+  energy.init(slices, slice);
+  for (int n = 0; n < iterations; n++) {
+    uint32_t c = cycleCount();
+    sink = floatRMS(buffer, SAMPLES_IN_SNIPPET);
+    floatCycles += cycleCount() - c;
+
+    c = cycleCount();
+    energy.addSlice(&buffer[(n % slices) * slice], slice);
+    sink = energy.isBelow(SILENCE_MEAN_SQUARE);
+    slidingCycles += cycleCount() - c;
+  }
+  (void)sink;
+  println("silence gate per slice of %u samples, window %u samples (host):", slice, SAMPLES_IN_SNIPPET);
+  println("   float RMS of the window %10.0f cycles", (double)floatCycles / iterations);
+  println("   sliding sum of squares  %10.0f cycles", (double)slidingCycles / iterations);
+  println("energy: %s", (failures == 0) ? "ok" : "failed");
+  return failures;
+}
+
+// the sample written at ring position pos, so every read can be checked against its position
+static int16_t ringSample(uint32_t pos) {
+  return (int16_t)(pos * 2654435761u >> 16);
+}
+
+static bool checkRingSamples(const int16_t* samples, uint32_t pos, size_t len) {
+  for (size_t i = 0; i < len; i++)
+    if (samples[i] != ringSample(pos + i))
+      return false;
+  return true;
+}
+
+// Writes a counting sequence in chunks of random length, through write() and writePtr()/commit(),
+// and checks after every chunk: the recent window reads back, a read the producer has lapped and
+// a read ahead of the producer fail, a view across the end of the buffer is split correctly.
+// Then the cost of a 1 s window per slice out of the ring against a window moved with memmove per
+// DMA buffer, as the pipeline did before. Returns the number of failed checks.
+static int testRingBuffer() {
+  const size_t N = 1024;
+  static RingBuffer<int16_t, N> ring;
+  static int16_t chunk[3 * N], copy[N];
+  int failures = 0;
+  srand(1);
+
+  // positions before the first lap hold zeros, not the sequence, the checks start with a full ring
+  uint32_t pos = N;
+  for (size_t i = 0; i < N; i++)
+    chunk[i] = ringSample(i);
+  ring.write(chunk, N);
+  uint32_t splitViews = 0;
+  for (int round = 0; (round < 20000) && (failures < 10); round++) {
+    // mostly DMA sized chunks, now and then one longer than the ring (only its tail survives)
+    size_t len = (round % 500 == 499) ? N + 1 + rand() % (2 * N) : 1 + rand() % (2 * I2S_DMA_BUF_LEN);
+    for (size_t i = 0; i < len; i++)
+      chunk[i] = ringSample(pos + i);
+    if (round % 2 == 0) {
+      ring.write(chunk, len);
+    } else {
+      // driver path: at most up to the end of the buffer per call
+      size_t done = 0;
+      while (done < len) {
+        size_t n;
+        int16_t* dst = ring.writePtr(len - done, n);
+        memcpy(dst, &chunk[done], n * sizeof(int16_t));
+        ring.commit(n);
+        done += n;
+      }
+    }
+    pos += len;
+
+    bool ok = (ring.written() == pos);
+    // the whole buffer and a random window within it
+    ok = ok && ring.read(pos - N, copy, N) && checkRingSamples(copy, pos - N, N);
+    size_t windowLen = 1 + rand() % N;
+    uint32_t windowPos = pos - windowLen - rand() % (N - windowLen + 1);
+    ok = ok && ring.read(windowPos, copy, windowLen) && checkRingSamples(copy, windowPos, windowLen);
+    ok = ok && ring.readLatest(copy, windowLen) && checkRingSamples(copy, pos - windowLen, windowLen);
+    // lapped by the producer, and not written yet
+    ok = ok && !ring.isValid(pos - N - 1, 1) && !ring.read(pos - N - 1, copy, 1);
+    ok = ok && !ring.read(pos - windowLen + 1, copy, windowLen);
+
+    const int16_t *part1, *part2;
+    size_t len1, len2;
+    ring.view(windowPos, windowLen, part1, len1, part2, len2);
+    ok = ok && (len1 + len2 == windowLen) && ((len2 == 0) || (((windowPos + len1) & (N - 1)) == 0));
+    ok = ok && checkRingSamples(part1, windowPos, len1) && checkRingSamples(part2, windowPos + len1, len2);
+    if (len2 > 0)
+      splitViews++;
+
+    if (!ok) {
+      println("   failed after %u samples (chunk %u, window %u at %u)", pos, len, windowLen, windowPos);
+      failures++;
+    }
+  }
+  println("ring of %u samples: %u samples written, %u split views", N, pos, splitViews);
+
+  // throughput: both consumers get a linear 1 s window once per slice of a quarter second
+  static RingBuffer<int16_t, AUDIO_RING_SIZE> audio;
+  static int16_t window[SAMPLES_IN_SNIPPET], linear[SAMPLES_IN_SNIPPET];
+  const size_t slice = SAMPLES_IN_SNIPPET / 4;
+  const uint32_t seconds = 60;
+  for (size_t i = 0; i < I2S_DMA_BUF_LEN; i++)
+    chunk[i] = ringSample(i);
+  uint64_t ringCycles = 0, moveCycles = 0;
+  uint32_t windows = 0;
+  for (uint32_t n = 0; n < seconds * SAMPLE_RATE; n += I2S_DMA_BUF_LEN) {
+    uint32_t c = cycleCount();
+    audio.write(chunk, I2S_DMA_BUF_LEN);
+    if ((n + I2S_DMA_BUF_LEN) % slice < I2S_DMA_BUF_LEN) {
+      audio.readLatest(linear, SAMPLES_IN_SNIPPET);
+      windows++;
+    }
+    ringCycles += cycleCount() - c;
+
+    c = cycleCount();
+    memmove(window, window + I2S_DMA_BUF_LEN, (SAMPLES_IN_SNIPPET - I2S_DMA_BUF_LEN) * sizeof(int16_t));
+    memcpy(window + SAMPLES_IN_SNIPPET - I2S_DMA_BUF_LEN, chunk, I2S_DMA_BUF_LEN * sizeof(int16_t));
+    moveCycles += cycleCount() - c;
+  }
+  if (memcmp(window, linear, sizeof(window)) != 0) {
+    println("   ring window differs from the moved window");
+    failures++;
+  }
+  uint32_t samples = seconds * SAMPLE_RATE;
+  println("%u s of audio, %u windows of %u samples (host):", seconds, windows, SAMPLES_IN_SNIPPET);
+  println("   ring    %8.2f cycles per sample", (double)ringCycles / samples);
+  println("   memmove %8.2f cycles per sample", (double)moveCycles / samples);
+  println("ringbuffer: %s", (failures == 0) ? "ok" : "failed");
+  return failures;
+}
+
+int main(int argc, char** argv) {
+  bool verbose = false;
+  const char* tracePath = NULL;
+  bool compareCascade = false;
+  bool compareInputLevels = false;
+  std::vector<fs::path> files;
+  for (int i = 1;i<argc;i++) {
+    if ((strcmp(argv[i], "--ema") == 0) && (i + 1 < argc)) {
+      decisionConfig.smoothing = SMOOTH_EMA;
+      decisionConfig.emaAlpha = atof(argv[++i]);
+    } else if ((strcmp(argv[i], "--window") == 0) && (i + 1 < argc)) {
+      decisionConfig.smoothing = SMOOTH_WINDOW;
+      decisionConfig.window = atoi(argv[++i]);
+    } else if ((strcmp(argv[i], "--on") == 0) && (i + 1 < argc)) {
+      decisionConfig.onThreshold = atof(argv[++i]);
+    } else if ((strcmp(argv[i], "--off") == 0) && (i + 1 < argc)) {
+      decisionConfig.offThreshold = atof(argv[++i]);
+    } else if ((strcmp(argv[i], "--refractory") == 0) && (i + 1 < argc)) {
+      decisionConfig.refractory_ms = atoi(argv[++i]);
+    } else if ((strcmp(argv[i], "--trace") == 0) && (i + 1 < argc)) {
+      return replayTrace(argv[i+1]);
+    } else if (strcmp(argv[i], "--no-cascade") == 0) {
+      cascadeConfig.enabled = false;
+    } else if (strcmp(argv[i], "--compare-cascade") == 0) {
+      compareCascade = true;
+    } else if ((strcmp(argv[i], "--level") == 0) && (i + 1 < argc)) {
+      inputGain = powf(10.0f, atof(argv[++i]) / 20.0f);
+    } else if (strcmp(argv[i], "--no-agc") == 0) {
+      agcConfig.enabled = false;
+    } else if (strcmp(argv[i], "--compare-levels") == 0) {
+      compareInputLevels = true;
+    } else if ((strcmp(argv[i], "--record-trace") == 0) && (i + 1 < argc)) {
+      tracePath = argv[++i];
+    } else if ((strcmp(argv[i], "--bench") == 0) && (i + 1 < argc)) {
+      setupInference();
+      initSpeechFilter();
+      initPipeline();
+      runBenchmark(atoi(argv[i+1]));
+      return 0;
+    } else if (strcmp(argv[i], "--resampler") == 0) {
+      return (testResampler() == 0) ? 0 : 1;
+    } else if (strcmp(argv[i], "--energy") == 0) {
+      return (testEnergy() == 0) ? 0 : 1;
+    } else if (strcmp(argv[i], "--ringbuffer") == 0) {
+      return (testRingBuffer() == 0) ? 0 : 1;
+    } else if (strcmp(argv[i], "-v") == 0) {
+      verbose = true;
+    } else if (fs::is_directory(argv[i])) {
+      for (auto &entry : fs::recursive_directory_iterator(argv[i]))
+        if (entry.is_regular_file() && (entry.path().extension() == ".wav"))
+          files.push_back(entry.path());
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.empty()) {
+    println("usage: %s [options] [-v] [--record-trace <out.csv>] <file.wav | directory> ... | --trace <trace.csv> | --bench <iterations> | --resampler | --energy | --ringbuffer | --compare-levels <file.wav | directory> ...", argv[0]);
+    return 1;
+  }
+  std::sort(files.begin(), files.end());
+
+  setupInference();
+  initSpeechFilter();
+  initPipeline();
+  if (get_no_of_labels() <= 1)
+    println("no classifier built in (configure with -DEI_SDK_DIR=...), only the signal path is simulated");
+
+  if (tracePath != NULL) {
+    traceOut = fopen(tracePath, "w");
+    if (traceOut == NULL) {
+      println("cannot write %s", tracePath);
+      return 1;
+    }
+    fprintf(traceOut, "time_ms,expected");
+    for (uint8_t i = 0;i<get_no_of_labels();i++)
+      fprintf(traceOut, ",%s", getLabelName(i));
+    fprintf(traceOut, "\n");
+    setSliceObserver(recordSlice);
+  }
+
+  if (compareInputLevels) {
+    compareLevels(files);
+    return 0;
+  }
+  if (compareCascade) {
+    cascadeConfig.enabled = false;
+    simulateSession(files, verbose);
+    println("");
+    cascadeConfig.enabled = true;
+  }
+  simulateSession(files, verbose);
+  if (traceOut != NULL)
+    fclose(traceOut);
+  return 0;
+}
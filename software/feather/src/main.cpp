@@ -12,6 +12,18 @@
 #include "EEPROMStorage.h"
 #include "terminal.h"
 #include "boardneopixel.h"
+#include "boot.h"
+#include "inference.h"
+#include "pipeline.h"
+#include "soundtools.h"
+#include "bleturn.h"
+#include "recording.h"
+#include "log.h"
+#include "scheduler.h"
+#include "cascade.h"
+#include "heapstats.h"
+#include "flightrecorder.h"
+#include "ota.h"
 
 // Operating Modes
 enum ModeType { MODE_NONE, MODE_PRODUCTION, MODE_RECORDING, MODE_STREAMING };
@@ -21,9 +33,20 @@ ModeType mode = MODE_PRODUCTION;                                 // current oper
 // last voltage measured
 float cellVoltage, cellPercentage;
 
+// scheduled tasks of loop()
+void processAudio();
+void processTerminal();
+void processButton();
+void processRecButton();
+void processModelUpdate();
+void readBattery();
+
 void setup() {
   Serial.begin(115200);
-  while (!Serial) delay(10);    // wait until serial monitor opens
+  uint32_t serialWait = millis();
+  while (!Serial && (millis() - serialWait < 500)) delay(10);    // native USB: give the serial monitor a moment, but do not wait for it
+  initLog();
+  traceLoopHeap();
 
   // set Neopixel
   initNeoPixel();
@@ -31,36 +54,202 @@ void setup() {
   // initialise the on-board battery monitor
   initBatteryMonitor();
 
+  pinMode(LED_REC_PIN, OUTPUT);
+  pinMode(REC_BUTTON_PIN, INPUT_PULLUP);
+
   // check memory
   uint32_t flashMem = ESP.getFlashChipSize();
   uint32_t PSRAMMem = ESP.getPsramSize();
 
   // initialise EPPROM
   persConfig.setup();
-  
+  logLevel = LOG_INFO + config.debugLevel;
+
   // show memory situation
   println("Flash  Size: %d KB", flashMem / (1024));
   println("PSRAM  Size: %d KB", PSRAMMem / (1024));
   println("EEPROM Size: %d B",  EEPROM.length()); // requires to have called persConfig.setup() beforehand
- 
+
   // print content of EEPROM
   config.model.print();
- 
-  // set up the Wifi
-  setupNetwork();
+  bootStageDone(BOOT_CORE);
+
+  // page turning first, it works offline: inference, recorder and audio capture (task on core 0)
+  setupInference();
+  initPipeline();
+  initRecorder();
+  initFlightRecorder();
+  setSliceObserver(flightRecordSlice);
+  initAudio();
+  bootStageDone(BOOT_AUDIO);
+
+  initBLE();
+  bootStageDone(BOOT_BLE);
 
   // set neopixel to production mode
   setNeoPixelMode(PIX_PRODUCTION_MODE);
+  bootStageDone(BOOT_READY);
+
+  // set up the Wifi in the background, may end in the captive portal
+  startNetwork();
+
+  // audio first, everything else runs in the slack
+  addPeriodicTask("audio",      processAudio,     10,    20,    PRIO_AUDIO);
+  addPeriodicTask("terminal",   processTerminal,  10,    50,    PRIO_CONTROL);
+  addPeriodicTask("powerbutton",processButton,    50,    100,   PRIO_CONTROL);
+  addPeriodicTask("recbutton",  processRecButton, 20,    100,   PRIO_CONTROL);
+  addPeriodicTask("neopixel",   loopNeoPixel,     50,    100,   PRIO_HOUSEKEEPING);
+  addPeriodicTask("battery",    readBattery,      5000,  1000,  PRIO_HOUSEKEEPING);
+  addPeriodicTask("model",      processModelUpdate,1000, 1000,  PRIO_HOUSEKEEPING);
+  addPeriodicTask("heartbeat",  requestHeartbeat, 60000, 10000, PRIO_HOUSEKEEPING);
+}
+
+// back to page turning after a take
+void endTake() {
+  mode = MODE_PRODUCTION;
+  initPipeline();
+  digitalWrite(LED_REC_PIN, LOW);
+  println("recording finished");
 }
 
+// classify the pending slices and turn the page, while recording the recorder takes the audio
+void processAudio() {
+  if (!isAudioAvailable())
+    return;
+  size_t added;
+  drainAudioData(added);
+  resetAudioWatchdog();
 
-void loop() {
-  // measure the battery 
-  readBatMonitor(cellVoltage, cellPercentage);
+  if (mode == MODE_STREAMING) {
+    // one frame per second, the frame completed after the button was released ends the take
+    bool hold = (digitalRead(REC_BUTTON_PIN) == LOW);
+    if (!processStreaming(hold) && !isUploading())
+      endTake();
+    return;
+  }
+  if (mode != MODE_PRODUCTION)
+    return;
+
+  PageTurnType turn = processPendingSlices();
+  if (pipelineTiming.inference.count > 0)
+    markFirstInference();
+
+  // short BLE connection interval while someone is playing, relaxed when it is quiet
+  static uint32_t lastTriggers = 0;
+  static uint32_t lastActivity = 0;
+  if (cascadeStats.stage1Triggers != lastTriggers) {
+    lastTriggers = cascadeStats.stage1Triggers;
+    lastActivity = millis();
+  }
+  setBleActive(millis() - lastActivity < BLE_ACTIVE_HOLD_MS);
 
-  // Process any manual serial commands
-  executeManualCommand();
+  if (turn == TURN_PAGE_DOWN)
+    sendPageDown();
+  if (turn == TURN_PAGE_UP)
+    sendPageUp();
+
+  // keep the audio around the decision for diagnosis
+  if (turn != TURN_NONE)
+    freezeFlightSnapshot((turn == TURN_PAGE_DOWN) ? FLIGHT_PAGE_DOWN : FLIGHT_PAGE_UP);
+}
+
+// power button: long press sleeps, a tap marks the last page turn as wrong
+void processButton() {
+  loopPowerButton();
+  if (powerButtonTapped())
+    freezeFlightSnapshot(FLIGHT_MANUAL);
+}
 
-  // update the neopixel 
-  loopNeoPixel();
+// Debounced recording button, LOW = pressed. Returns true if the state changed.
+bool checkRecButton(bool& pressed) {
+  const uint32_t debounceDelay = 50;             // [ms]
+  static uint8_t lastReading = HIGH;
+  static uint8_t stableState = HIGH;
+  static uint32_t lastChange = 0;
+
+  uint8_t reading = digitalRead(REC_BUTTON_PIN);
+  if (reading != lastReading)
+    lastChange = millis();
+  lastReading = reading;
+
+  if ((millis() - lastChange > debounceDelay) && (reading != stableState)) {
+    stableState = reading;
+    pressed = (stableState == LOW);
+    return true;
+  }
+  return false;
+}
+
+// recording button: a tap records a take until the next tap, holding it for a second streams
+// with the classifier results for as long as it is held
+void processRecButton() {
+  static bool pressed = false;
+  static uint32_t pressedSince = 0;
+  static bool waitForRelease = false;            // the press has started something already
+  bool changed = checkRecButton(pressed);
+  bool handled = waitForRelease;
+  if (changed && pressed)
+    pressedSince = millis();
+  if (changed && !pressed)
+    waitForRelease = false;
+
+  switch (mode) {
+    case MODE_PRODUCTION:
+      if (handled)
+        break;
+      if (pressed && (millis() - pressedSince >= 1000)) {
+        // held: stream until the button is released
+        waitForRelease = true;
+        if (startStreaming()) {
+          println("start streaming");
+          digitalWrite(LED_REC_PIN, HIGH);
+          mode = MODE_STREAMING;
+        }
+      } else if (changed && !pressed) {
+        // released within a second, not starting before the release keeps the click out of the take
+        if (startRecording()) {
+          println("start recording");
+          digitalWrite(LED_REC_PIN, HIGH);
+          mode = MODE_RECORDING;
+        }
+      }
+      break;
+
+    case MODE_RECORDING:
+      // the next tap stops, a failed upload ends the take as well
+      if ((changed && pressed) || !isUploading()) {
+        if (changed && pressed)
+          waitForRelease = true;
+        stopRecording();
+        endTake();
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+// Process any manual serial commands
+void processTerminal() {
+  do
+    executeManualCommand();
+  while (Serial.available());
+}
+
+// switch to a model the network task has downloaded
+void processModelUpdate() {
+  if (activatePendingModel())
+    initPipeline();
+}
+
+// measure the battery
+void readBattery() {
+  readBatMonitor(cellVoltage, cellPercentage);
+}
+
+void loop() {
+  // nothing due, give the time to the other tasks
+  if (!runScheduler())
+    delay(1);
 }
@@ -3,6 +3,7 @@ echo on
 
   
 ./unpacklibraries.sh -a model/ei-pageturner* -c model/pageturner*
+./checkmodel.sh ./uC/lib/ei_arduino_library || echo "the new model will run on slow kernels, see above"
 cd PC/inference
 make clean
 make -j
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""
+Packs a tflite model into the container the feather loads from a flash partition
+(see feather/lib/Utils/modelstore.h) and optionally flashes it.
+
+  packmodel.py model.tflite -o model.bin [--lib uC/lib/ei_arduino_library] [--language Deutsch]
+  packmodel.py model.tflite -o model.bin --flash --port /dev/ttyACM0 --slot 1
+
+The DSP parameters and labels are taken from the Edge Impulse library the firmware was built with,
+the container is only accepted by the firmware if they match.
+"""
+import argparse
+import os
+import re
+import struct
+import subprocess
+import sys
+import zlib
+
+MAGIC = b"TTMC"
+FORMAT = 1
+MAX_LABELS = 10
+LABEL_LEN = 24
+ALIGN = 16
+
+# offsets of model0, model1 in feather/partitions.csv
+SLOT_OFFSETS = [0x590000, 0x690000]
+SLOT_SIZE = 0x100000
+
+HEADER_PREFIX = struct.Struct("<4sHHII16sIIIIB3s")
+HEADER_SIZE = HEADER_PREFIX.size + MAX_LABELS * LABEL_LEN + 4 * 4
+
+
+def read_define(text, name):
+    m = re.search(r"^#define\s+%s\s+(\d+)" % name, text, re.MULTILINE)
+    if not m:
+        raise ValueError("%s not found in model_metadata.h" % name)
+    return int(m.group(1))
+
+
+def read_library(lib_dir):
+    with open(os.path.join(lib_dir, "model-parameters", "model_metadata.h")) as f:
+        meta = f.read()
+    params = {
+        "frequency": read_define(meta, "EI_CLASSIFIER_FREQUENCY"),
+        "raw_sample_count": read_define(meta, "EI_CLASSIFIER_RAW_SAMPLE_COUNT"),
+        "input_frame_size": read_define(meta, "EI_CLASSIFIER_NN_INPUT_FRAME_SIZE"),
+        "arena_size": read_define(meta, "EI_CLASSIFIER_TFLITE_LARGEST_ARENA_SIZE"),
+        "project_id": read_define(meta, "EI_CLASSIFIER_PROJECT_ID"),
+        "version": read_define(meta, "EI_CLASSIFIER_PROJECT_DEPLOY_VERSION"),
+    }
+    with open(os.path.join(lib_dir, "model-parameters", "model_variables.h")) as f:
+        variables = f.read()
+    m = re.search(r"ei_classifier_inferencing_categories\[\]\s*=\s*\{([^}]*)\}", variables)
+    params["labels"] = re.findall(r'"([^"]*)"', m.group(1)) if m else []
+    return params
+
+
+def pack(model, params, language):
+    labels = params["labels"]
+    if not labels or len(labels) > MAX_LABELS:
+        raise ValueError("need 1..%d labels, got %d" % (MAX_LABELS, len(labels)))
+    model_offset = (HEADER_SIZE + ALIGN - 1) // ALIGN * ALIGN
+
+    header = HEADER_PREFIX.pack(MAGIC, FORMAT, HEADER_SIZE, params["version"], params["project_id"],
+                                language.encode()[:15], params["frequency"], params["raw_sample_count"],
+                                params["input_frame_size"], params["arena_size"], len(labels), b"\0\0\0")
+    for i in range(MAX_LABELS):
+        label = labels[i].encode() if i < len(labels) else b""
+        if len(label) >= LABEL_LEN:
+            raise ValueError("label '%s' too long" % labels[i])
+        header += label.ljust(LABEL_LEN, b"\0")
+    header += struct.pack("<III", model_offset, len(model), zlib.crc32(model))
+    header += struct.pack("<I", zlib.crc32(header))
+    return header.ljust(model_offset, b"\xff") + model
+
+
+def main():
+    parser = argparse.ArgumentParser(description="pack a tflite model into a feather model partition image")
+    parser.add_argument("model", help="tflite flatbuffer (int8)")
+    parser.add_argument("-o", "--output", default="model.bin")
+    parser.add_argument("--lib", default="./uC/lib/ei_arduino_library", help="Edge Impulse library the firmware uses")
+    parser.add_argument("--labels", help="comma separated labels, overrides the library")
+    parser.add_argument("--language", default="")
+    parser.add_argument("--flash", action="store_true", help="write the image with esptool")
+    parser.add_argument("--port", default=None)
+    parser.add_argument("--slot", type=int, default=0, choices=range(len(SLOT_OFFSETS)))
+    args = parser.parse_args()
+
+    with open(args.model, "rb") as f:
+        model = f.read()
+    params = read_library(args.lib)
+    if args.labels:
+        params["labels"] = args.labels.split(",")
+
+    image = pack(model, params, args.language)
+    if len(image) > SLOT_SIZE:
+        sys.exit("image of %d bytes does not fit into the %d bytes of a model partition" % (len(image), SLOT_SIZE))
+    with open(args.output, "wb") as f:
+        f.write(image)
+    print("%s: model version %d, %d bytes, labels %s" % (args.output, params["version"], len(image), ",".join(params["labels"])))
+
+    if args.flash:
+        cmd = [sys.executable, "-m", "esptool"]
+        if args.port:
+            cmd += ["--port", args.port]
+        cmd += ["write_flash", hex(SLOT_OFFSETS[args.slot]), args.output]
+        subprocess.check_call(cmd)
+        print("flashed to model%d, select it with 'm%d' on the terminal" % (args.slot, args.slot))
+
+
+if __name__ == "__main__":
+    main()
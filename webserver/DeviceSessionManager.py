@@ -15,6 +15,7 @@ class DeviceSessionManager:
             self.sessions[chip_id] = {
                 'language': 'Deutsch',
                 'label': 'All Labels',
+                'codec': 'pcm16',
                 'last_active': datetime.now(),
                 'last_recorded_filename': None,
                 'last_recording_timestamp': None
@@ -32,6 +33,7 @@ class DeviceSessionManager:
             self.sessions[chip_id] = {
                 'language': 'Deutsch',  # default
                 'label': 'All Labels',  # default
+                'codec': 'pcm16',       # audio codec of uploads and streams, 'pcm16' or 'adpcm'
                 'last_active': datetime.now()
             }
         return self.sessions[chip_id]
@@ -46,6 +48,14 @@ class DeviceSessionManager:
         session['label'] = label
         session['last_active'] = datetime.now()
     
+    def update_codec(self, chip_id, codec):
+        session = self.get_or_create_session(chip_id)
+        session['codec'] = codec
+        session['last_active'] = datetime.now()
+
+    def get_codec(self, chip_id):
+        return self.get_or_create_session(chip_id).get('codec', 'pcm16')
+    
     def cleanup_inactive_sessions(self, max_inactive_minutes=60):
         """Remove sessions that haven't been active for a while"""
         cutoff = datetime.now() - timedelta(minutes=max_inactive_minutes)
@@ -0,0 +1,106 @@
+import os, sys, threading
+import otadelta
+
+# Releases for the OTA updates of the devices, one folder per target:
+#   <ota dir>/app/*.bin     firmware images (.pio/build/<env>/firmware.bin)
+#   <ota dir>/model/*.bin   model containers (software/packmodel.py)
+# The newest file of a folder is the current release. A device sends the SHA-256 of what it runs,
+# if that is an older release it gets a delta patch (cached in <ota dir>/patches), otherwise the full image.
+
+class OtaManager:
+    def __init__(self, ota_dir):
+        self.ota_dir = ota_dir
+        self.patch_dir = os.path.join(ota_dir, 'patches')
+        self.lock = threading.Lock()
+        self.known = {}                     # path -> (mtime, sha256 hex)
+        for target in otadelta.TARGETS:
+            os.makedirs(os.path.join(ota_dir, target), exist_ok=True)
+        os.makedirs(self.patch_dir, exist_ok=True)
+
+    def _sha(self, path):
+        mtime = os.path.getmtime(path)
+        cached = self.known.get(path)
+        if cached and cached[0] == mtime:
+            return cached[1]
+        with open(path, 'rb') as f:
+            sha = otadelta.sha256(f.read()).hex()
+        self.known[path] = (mtime, sha)
+        return sha
+
+    def releases(self, target):
+        """Release files of a target, newest first."""
+        folder = os.path.join(self.ota_dir, target)
+        files = [os.path.join(folder, f) for f in os.listdir(folder) if f.endswith('.bin')]
+        return sorted(files, key=os.path.getmtime, reverse=True)
+
+    def get_patch(self, target, current_sha):
+        """Patch from the image with current_sha to the newest release, None if the device is up to date."""
+        if target not in otadelta.TARGETS:
+            raise ValueError('unknown target %s' % target)
+        with self.lock:
+            releases = self.releases(target)
+            if not releases:
+                return None
+            newest = releases[0]
+            newest_sha = self._sha(newest)
+            if current_sha == newest_sha:
+                return None
+
+            base = next((r for r in releases[1:] if self._sha(r) == current_sha), None)
+            cache = os.path.join(self.patch_dir, '%s_%s_%s.patch' % (target, current_sha[:16] if base else 'full', newest_sha[:16]))
+            if not os.path.exists(cache):
+                with open(newest, 'rb') as f:
+                    new = f.read()
+                old = b''
+                if base:
+                    with open(base, 'rb') as f:
+                        old = f.read()
+                patch = otadelta.diff(old, new, otadelta.TARGETS[target])
+                with open(cache, 'wb') as f:
+                    f.write(patch)
+                print('OTA %s: %s patch %s -> %s, %d bytes for an image of %d bytes'
+                      % (target, 'delta' if base else 'full', os.path.basename(base) if base else '-',
+                         os.path.basename(newest), len(patch), len(new)))
+            with open(cache, 'rb') as f:
+                return f.read()
+
+
+# stand-in for the backend, serves only the OTA endpoints of ttwebserver.py:
+#   python3 OtaManager.py [port] [ota dir]
+if __name__ == '__main__':
+    from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+    from urllib.parse import urlparse, parse_qs
+
+    port = int(sys.argv[1]) if len(sys.argv) > 1 else 8000
+    manager = OtaManager(sys.argv[2] if len(sys.argv) > 2 else os.path.join(os.path.dirname(os.path.abspath(__file__)), '../ota'))
+
+    class Handler(BaseHTTPRequestHandler):
+        def do_GET(self):
+            url = urlparse(self.path)
+            parts = url.path.strip('/').split('/')          # api/ota/<target>/<device_id>
+            if len(parts) != 4 or parts[:2] != ['api', 'ota']:
+                self.send_error(404)
+                return
+            try:
+                patch = manager.get_patch(parts[2], parse_qs(url.query).get('sha', [''])[0])
+            except ValueError as e:
+                self.send_error(400, str(e))
+                return
+            if patch is None:
+                self.send_response(204)
+                self.end_headers()
+                return
+            self.send_response(200)
+            self.send_header('Content-Type', 'application/octet-stream')
+            self.send_header('Content-Length', str(len(patch)))
+            self.end_headers()
+            self.wfile.write(patch)
+
+        def do_POST(self):
+            length = int(self.headers.get('Content-Length', 0))
+            print('OTA report %s: %s' % (self.path, self.rfile.read(length).decode(errors='replace')))
+            self.send_response(200)
+            self.end_headers()
+
+    print('OTA stand-in server on port %d, releases in %s' % (port, manager.ota_dir))
+    ThreadingHTTPServer(('0.0.0.0', port), Handler).serve_forever()
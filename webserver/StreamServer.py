@@ -0,0 +1,114 @@
+import socketserver, struct, wave
+import adpcm
+from threading import Thread
+
+# Binary frame format sent by the devices over one persistent TCP connection
+# (see software/feather/lib/Utils/streaming.h), all fields little endian:
+#   magic 'TT', version, type, device_id (u64), seq (u32), sample_rate (u16),
+#   format, flags, label_count, reserved, samples (u16), payload_bytes (u32)
+# followed by label_count float32 confidences and the payload.
+HEADER = struct.Struct('<2sBBQIHBBBBHI')
+MAGIC = b'TT'
+VERSION = 1
+
+FRAME_AUDIO = 1
+FRAME_HEARTBEAT = 2       # payload decoded by heartbeat.py, handled through frame_handlers
+
+FORMAT_PCM16 = 0
+FORMAT_IMA_ADPCM = 1      # one ADPCM block per frame
+
+FLAG_START = 0x01
+FLAG_END = 0x02
+
+BYTES_PER_SAMPLE = 2
+SAMPLE_RATE = 16000
+MAX_PAYLOAD_BYTES = SAMPLE_RATE * BYTES_PER_SAMPLE   # frames carry at most one second of PCM16
+
+
+def read_exactly(sock, size):
+    data = bytearray()
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        if not chunk:
+            raise ConnectionError("connection closed")
+        data.extend(chunk)
+    return bytes(data)
+
+
+class StreamHandler(socketserver.BaseRequestHandler):
+    def handle(self):
+        server = self.server
+        takes = {}              # device_id -> (wave file, relative path), kept open across frames
+        last_seq = None
+        try:
+            while True:
+                (magic, version, frame_type, device_id, seq, sample_rate, sample_format,
+                 flags, label_count, _, samples, payload_bytes) = HEADER.unpack(read_exactly(self.request, HEADER.size))
+                if magic != MAGIC or version != VERSION:
+                    print(f"stream: invalid frame header from {self.client_address}")
+                    return
+                if payload_bytes > MAX_PAYLOAD_BYTES:
+                    print(f"stream: frame of {payload_bytes} bytes from {self.client_address} rejected")
+                    return
+
+                confidences = struct.unpack(f'<{label_count}f', read_exactly(self.request, label_count * 4))
+                payload = read_exactly(self.request, payload_bytes)
+
+                if last_seq is not None and seq != last_seq + 1:
+                    print(f"stream: frames lost between {last_seq} and {seq}")
+                last_seq = seq
+
+                device = format(device_id, 'x')
+                handler = server.frame_handlers.get(frame_type)
+                if handler:
+                    handler(device, seq, flags, confidences, payload)
+                    continue
+                if frame_type != FRAME_AUDIO:
+                    continue
+
+                # append audio to the open take of this device
+                if flags & FLAG_START or device not in takes:
+                    if device in takes:
+                        self.close_take(device, takes.pop(device))
+                    filepath, relative_path = server.open_take(device)
+                    wav_file = wave.open(filepath, 'wb')
+                    wav_file.setnchannels(1)
+                    wav_file.setsampwidth(BYTES_PER_SAMPLE)
+                    wav_file.setframerate(sample_rate)
+                    takes[device] = (wav_file, relative_path)
+
+                pcm = server.decoders.get(sample_format, lambda p, n: p)(payload, samples)
+                takes[device][0].writeframes(pcm)
+
+                if flags & FLAG_END:
+                    self.close_take(device, takes.pop(device))
+        except ConnectionError:
+            pass
+        finally:
+            for device, take in takes.items():
+                self.close_take(device, take)
+
+    def close_take(self, device, take):
+        wav_file, relative_path = take
+        wav_file.close()
+        self.server.close_take(device, relative_path)
+
+
+class StreamServer(socketserver.ThreadingTCPServer):
+    """TCP server receiving framed audio from the devices.
+    open_take(device_id) returns (filepath, relative_path) of a new recording,
+    close_take(device_id, relative_path) is called once the take is complete."""
+    allow_reuse_address = True
+    daemon_threads = True
+
+    def __init__(self, port, open_take, close_take):
+        super().__init__(('0.0.0.0', port), StreamHandler)
+        self.open_take = open_take
+        self.close_take = close_take
+        self.decoders = {FORMAT_PCM16: lambda payload, samples: payload,
+                         FORMAT_IMA_ADPCM: adpcm.decode_block}
+        self.frame_handlers = {}
+
+    def start(self):
+        Thread(target=self.serve_forever, daemon=True).start()
+        print(f"Stream server listening on port {self.server_address[1]}")
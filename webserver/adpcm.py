@@ -0,0 +1,56 @@
+import struct
+
+# IMA-ADPCM decoder for the blocks encoded by the devices (see software/feather/lib/Utils/adpcm.h):
+# 4 byte header (predictor int16, step index, reserved) followed by two samples per byte, low nibble first.
+
+HEADER_BYTES = 4
+BLOCK_SAMPLES = 1024                      # block size of HTTP uploads
+BLOCK_BYTES = HEADER_BYTES + BLOCK_SAMPLES // 2
+
+STEP_TABLE = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+]
+
+INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8]
+
+
+def decode_block(block, samples=None):
+    """Decode one ADPCM block into PCM16 bytes, samples limits the output (a block of an odd count is padded)."""
+    predictor, index, _ = struct.unpack_from('<hBB', block)
+    index = min(index, 88)
+    pcm = []
+    for byte in block[HEADER_BYTES:]:
+        for nibble in (byte & 0x0F, byte >> 4):
+            step = STEP_TABLE[index]
+            delta = step >> 3
+            if nibble & 4:
+                delta += step
+            if nibble & 2:
+                delta += step >> 1
+            if nibble & 1:
+                delta += step >> 2
+            predictor += -delta if nibble & 8 else delta
+            predictor = max(-32768, min(32767, predictor))
+            index = max(0, min(88, index + INDEX_TABLE[nibble & 7]))
+            pcm.append(predictor)
+    if samples is not None:
+        pcm = pcm[:samples]
+    return struct.pack(f'<{len(pcm)}h', *pcm)
+
+
+def decode_stream(read):
+    """Decode an upload of consecutive blocks, read(size) returns the next bytes of the upload."""
+    while True:
+        block = b''
+        while len(block) < BLOCK_BYTES:
+            data = read(BLOCK_BYTES - len(block))
+            if not data:
+                break
+            block += data
+        if len(block) <= HEADER_BYTES:
+            break
+        yield decode_block(block)
@@ -0,0 +1,124 @@
+import math
+import struct
+
+# Heartbeat of a device, payload of a FRAME_HEARTBEAT on the stream connection
+# (see software/feather/lib/Utils/heartbeat.h), all fields little endian.
+# Counters run since the boot of the device. Newer versions append fields.
+VERSION = 2
+LATENCY_BUCKETS = 8
+LATENCY_BUCKET_0_US = 4000
+MAX_LABELS = 10
+CPU_UNKNOWN = 255
+
+FRAME = struct.Struct('<BB2BI'                  # version, label_count, cpu load per core, uptime
+                      'HHII16s32sII'            # firmware, MHz, flash, psram, chip, owner, connect_ms, first_inference_ms
+                      'III'                     # free heap, lowest free heap, largest free block
+                      'III'                     # captured, dropped, overrun samples
+                      '%dII' % LATENCY_BUCKETS  # inference latency histogram, max
+                      + 'bBHIIII'               # rssi, ble connected, interval, notify mean/max, complete mean/max
+                      'HBB'                     # battery mV, percent, reserved
+                      '%dI%dI' % (MAX_LABELS, MAX_LABELS))   # slice winners, page turns per label
+FRAME_AGC = struct.Struct('<HHIII')             # version 2: gain (Q12), level, blocks, gated blocks, clipped samples
+AGC_UNITY = 1 << 12
+
+
+def _text(raw):
+    return raw.split(b'\0', 1)[0].decode(errors='replace')
+
+
+def latency_percentile(histogram, q):
+    """Upper bound of the bucket holding the q-quantile in ms, None without samples
+    (the last bucket is open ended, its lower bound is returned)."""
+    total = sum(histogram)
+    if total == 0:
+        return None
+    limit = LATENCY_BUCKET_0_US
+    count = 0
+    for i, n in enumerate(histogram):
+        count += n
+        if count >= q * total:
+            return (limit if i < LATENCY_BUCKETS - 1 else limit // 2) / 1000.0
+        limit *= 2
+    return None
+
+
+def decode(payload):
+    """Heartbeat as a flat dict with the keys of the device registry, None if it is not understood."""
+    if len(payload) < FRAME.size or not 1 <= payload[0] <= VERSION:
+        return None
+    v = FRAME.unpack_from(payload)
+    labels = v[1]
+    latency = list(v[19:19 + LATENCY_BUCKETS])
+    i = 19 + LATENCY_BUCKETS
+    (inference_max_us, rssi, ble_connected, ble_interval, notify_mean, notify_max,
+     complete_mean, complete_max, battery_mv, battery_percent, _) = v[i:i + 11]
+    i += 11
+    cpu = [None if load == CPU_UNKNOWN else load for load in v[2:4]]
+    data = {
+        'uptime_s': v[4] // 1000,
+        'version': str(v[5]),
+        'cpu': str(v[6]),
+        'flash': v[7],
+        'psram': v[8],
+        'board': _text(v[9]),
+        'chip': _text(v[9]),
+        'owner': _text(v[10]),
+        'connect_ms': v[11],
+        'first_inference_ms': v[12],
+        'heap': v[13],
+        'heap_min': v[14],
+        'heap_largest_block': v[15],
+        'captured_samples': v[16],
+        'dropped_samples': v[17],
+        'overrun_samples': v[18],
+        'cpu_load': cpu,
+        'inference_latency': latency,
+        'inference_p50_ms': latency_percentile(latency, 0.5),
+        'inference_p99_ms': latency_percentile(latency, 0.99),
+        'inference_max_ms': inference_max_us / 1000.0,
+        'rssi': rssi,
+        'ble_connected': bool(ble_connected),
+        'ble_interval_ms': ble_interval * 1.25,
+        'ble_notify_ms': [notify_mean / 1000.0, notify_max / 1000.0],
+        'ble_complete_ms': [complete_mean / 1000.0, complete_max / 1000.0],
+        'battery_mv': battery_mv,
+        'battery_percent': battery_percent,
+        'slice_winners': list(v[i:i + labels]),
+        'label_turns': list(v[i + MAX_LABELS:i + MAX_LABELS + labels]),
+    }
+    if payload[0] >= 2 and len(payload) >= FRAME.size + FRAME_AGC.size:
+        gain, level, blocks, gated, clipped = FRAME_AGC.unpack_from(payload, FRAME.size)
+        data.update({
+            'agc_gain_db': round(20 * math.log10(max(gain, 1) / AGC_UNITY), 1),
+            'agc_level': level,
+            'agc_blocks': blocks,
+            'agc_gated_blocks': gated,
+            'agc_clipped_samples': clipped,
+        })
+    return data
+
+
+def delta(previous, current):
+    """Fields of current that are new or differ from previous, what the dashboard needs to update."""
+    return {key: value for key, value in current.items() if previous.get(key) != value}
+
+
+if __name__ == '__main__':
+    # self check with a synthetic heartbeat
+    frame = FRAME.pack(VERSION, 3, 42, CPU_UNKNOWN, 61000,
+                       8, 240, 8 << 20, 2 << 20, b'ESP32-D0WD-V3', b'jochen', 2100, 1800,
+                       150000, 120000, 90000,
+                       160000, 0, 512,
+                       5, 80, 10, 3, 0, 0, 0, 0, 35000,
+                       -61, 1, 12, 900, 2100, 14000, 22000,
+                       4012, 87, 0,
+                       *([100, 20, 3] + [0] * 7), *([0, 2, 1] + [0] * 7))
+    assert 'agc_gain_db' not in decode(bytes([1]) + frame[1:])      # version 1 devices
+    frame += FRAME_AGC.pack(2 * AGC_UNITY, 1300, 400, 25, 0)
+    hb = decode(frame)
+    assert hb['agc_gain_db'] == 6.0 and hb['agc_gated_blocks'] == 25
+    assert hb['owner'] == 'jochen' and hb['cpu_load'] == [42, None] and hb['slice_winners'] == [100, 20, 3]
+    assert hb['inference_p50_ms'] == 8.0 and hb['rssi'] == -61 and hb['ble_interval_ms'] == 15.0
+    changed = delta(hb, dict(hb, rssi=-70, heap=140000))
+    assert set(changed) == {'rssi', 'heap'}
+    print('heartbeat frame %d bytes, ok' % (FRAME.size + FRAME_AGC.size))
@@ -0,0 +1,189 @@
+import hashlib, struct, sys, time, zlib
+
+# Binary delta patches for the OTA updates of the devices (see software/feather/lib/Utils/ota.h).
+# A patch turns the image the device is running (firmware or model container) into the new one.
+# It is applied as a stream with constant RAM: the ops are written in order of the new image,
+# DIFF ops read the old image at random positions, ADD ops carry new bytes.
+#
+#   header (HEADER, uncompressed)
+#   zlib stream of ops, each op header (OP) followed by its data:
+#     OP_DIFF oldOffset len  + len bytes, new[i] = old[oldOffset + i] + data[i] (mod 256)
+#     OP_ADD  0         len  + len bytes, new[i] = data[i]
+#     OP_END  0         0
+# Pointer shifts after a code change make most DIFF bytes zero, which zlib compresses well.
+# A full image is a patch with oldSize 0 and a single ADD.
+
+MAGIC = b'TTDP'
+FORMAT = 1
+TARGET_APP = 0
+TARGET_MODEL = 1
+TARGETS = {'app': TARGET_APP, 'model': TARGET_MODEL}
+
+HEADER = struct.Struct('<4sBBHI32sI32sI')   # magic, format, target, reserved, oldSize, oldSha, newSize, newSha, payloadBytes
+OP = struct.Struct('<BII')                  # type, oldOffset, len
+OP_END, OP_DIFF, OP_ADD = 0, 1, 2
+
+BLOCK = 16        # length of the seeds that are looked up in the old image
+STEP = 4          # seeds are indexed at every STEP-th position of the old image
+WINDOW = 32       # a DIFF ends when less than half of the last WINDOW bytes match
+CHUNK = 64        # fast path for identical stretches
+
+
+def sha256(data):
+    return hashlib.sha256(data).digest()
+
+
+def _extend(old, new, o, s):
+    """End (in new) of the approximate match of new[s:] and old[o:]."""
+    n = min(len(old) - o, len(new) - s)
+    k = 0
+    last_match = 0
+    misses = []                             # mismatch flags of the last WINDOW bytes
+    miss_count = 0
+    while k < n:
+        if k + CHUNK <= n and old[o + k:o + k + CHUNK] == new[s + k:s + k + CHUNK]:
+            k += CHUNK
+            last_match = k
+            misses = []
+            miss_count = 0
+            continue
+        miss = old[o + k] != new[s + k]
+        if not miss:
+            last_match = k + 1
+        misses.append(miss)
+        miss_count += miss
+        if len(misses) > WINDOW:
+            miss_count -= misses.pop(0)
+        if miss_count * 2 > WINDOW:
+            break
+        k += 1
+    return s + last_match
+
+
+def diff(old, new, target=TARGET_APP, level=9):
+    """Patch from old to new, old may be empty (full image)."""
+    index = {}
+    for p in range(0, len(old) - BLOCK + 1, STEP):
+        index.setdefault(old[p:p + BLOCK], p)
+
+    ops = bytearray()
+
+    def add(start, end):
+        if end > start:
+            ops.extend(OP.pack(OP_ADD, 0, end - start))
+            ops.extend(new[start:end])
+
+    literal = 0                             # start of the bytes not covered yet
+    delta = None                            # alignment (old - new) of the last DIFF
+    i = 0
+    while i <= len(new) - BLOCK:
+        seed = new[i:i + BLOCK]
+        if delta is not None and 0 <= i + delta <= len(old) - BLOCK and old[i + delta:i + delta + BLOCK] == seed:
+            p = i + delta
+        else:
+            p = index.get(seed)
+            if p is None:
+                i += 1
+                continue
+        # extend backwards into the uncovered bytes
+        s, o = i, p
+        while s > literal and o > 0 and new[s - 1] == old[o - 1]:
+            s -= 1
+            o -= 1
+        e = _extend(old, new, o, s)
+        add(literal, s)
+        ops.extend(OP.pack(OP_DIFF, o, e - s))
+        ops.extend(bytes((a - b) & 0xFF for a, b in zip(new[s:e], old[o:e - s + o])))
+        literal = i = e
+        delta = o - s
+    add(literal, len(new))
+    ops.extend(OP.pack(OP_END, 0, 0))
+
+    payload = zlib.compress(bytes(ops), level)
+    header = HEADER.pack(MAGIC, FORMAT, target, 0, len(old), sha256(old) if old else bytes(32),
+                         len(new), sha256(new), len(payload))
+    return header + payload
+
+
+def full(new, target=TARGET_APP):
+    return diff(b'', new, target)
+
+
+def parse_header(patch):
+    magic, fmt, target, _, old_size, old_sha, new_size, new_sha, payload = HEADER.unpack_from(patch)
+    if magic != MAGIC or fmt != FORMAT:
+        raise ValueError('not a patch')
+    return {'target': target, 'old_size': old_size, 'old_sha': old_sha,
+            'new_size': new_size, 'new_sha': new_sha, 'payload': payload}
+
+
+def apply(old, patch):
+    """Apply a patch the way the device does, op by op from the decompressed stream."""
+    h = parse_header(patch)
+    if h['old_size'] and (len(old) < h['old_size'] or sha256(old[:h['old_size']]) != h['old_sha']):
+        raise ValueError('patch does not fit the old image')
+    ops = zlib.decompress(patch[HEADER.size:HEADER.size + h['payload']])
+    out = bytearray()
+    pos = 0
+    while True:
+        op, offset, length = OP.unpack_from(ops, pos)
+        pos += OP.size
+        if op == OP_END:
+            break
+        data = ops[pos:pos + length]
+        pos += length
+        if op == OP_ADD:
+            out.extend(data)
+        elif op == OP_DIFF:
+            if offset + length > h['old_size']:
+                raise ValueError('DIFF beyond the old image')
+            out.extend((a + b) & 0xFF for a, b in zip(data, old[offset:offset + length]))
+        else:
+            raise ValueError('unknown op %d' % op)
+    if len(out) != h['new_size'] or sha256(out) != h['new_sha']:
+        raise ValueError('patched image does not verify')
+    return bytes(out)
+
+
+def roundtrip(old, new, target=TARGET_APP):
+    """Diff, apply and verify, returns the patch size."""
+    start = time.time()
+    patch = diff(old, new, target)
+    diff_time = time.time() - start
+    if apply(old, patch) != new:
+        raise ValueError('round trip failed')
+    full_size = len(full(new, target))
+    print('old %d bytes, new %d bytes: patch %d bytes (%.1f%% of the image, full image compressed %d bytes), diff took %.1fs'
+          % (len(old), len(new), len(patch), 100.0 * len(patch) / max(len(new), 1), full_size, diff_time))
+    return len(patch)
+
+
+def _read(path):
+    with open(path, 'rb') as f:
+        return f.read()
+
+
+if __name__ == '__main__':
+    usage = ('otadelta.py diff <old> <new> <patch> [app|model]\n'
+             'otadelta.py apply <old> <patch> <new>\n'
+             'otadelta.py roundtrip <old> <new>')
+    if len(sys.argv) < 4:
+        sys.exit(usage)
+    cmd = sys.argv[1]
+    if cmd == 'diff' and len(sys.argv) >= 5:
+        target = TARGETS[sys.argv[5]] if len(sys.argv) > 5 else TARGET_APP
+        patch = diff(_read(sys.argv[2]), _read(sys.argv[3]), target)
+        with open(sys.argv[4], 'wb') as f:
+            f.write(patch)
+        print('%s: %d bytes' % (sys.argv[4], len(patch)))
+    elif cmd == 'apply' and len(sys.argv) >= 5:
+        with open(sys.argv[4], 'wb') as f:
+            f.write(apply(_read(sys.argv[2]), _read(sys.argv[3])))
+    elif cmd == 'roundtrip':
+        try:
+            roundtrip(_read(sys.argv[2]), _read(sys.argv[3]))
+        except ValueError as e:
+            sys.exit(str(e))
+        print('round trip ok')
+    else:
+        sys.exit(usage)
@@ -444,7 +444,10 @@ function connectGlobalWebSocket() {
 }
 
 
+let currentDevice = {};                 // last known state of the selected device, heartbeats send only changes
+
 function updateDeviceInfo(device) {
+    currentDevice = device;
     $$("device_owner").setValue(device.owner);
     $$("device_chip_id").setValue(device.id);
     $$("device_board").setValue(device.board);
@@ -453,6 +456,34 @@ function updateDeviceInfo(device) {
     $$("device_heap").setValue(formatBytes(device.heap));
     $$("device_version").setValue(device.version );
     $$("device_lastseen").setValue(formatDate(device.last_seen) );
+    if (device.codec)
+        $$("device_codec").setValue(device.codec);
+    updateDevicePerformance(device);
+}
+
+// runtime performance out of the heartbeat, empty for devices that only sent the device info
+function updateDevicePerformance(device) {
+    const ms = (v) => (v === null || v === undefined) ? "-" : v.toFixed(1) + " ms";
+    if (device.inference_latency)
+        $$("device_inference").setValue(`p50 ${ms(device.inference_p50_ms)}, p99 ${ms(device.inference_p99_ms)}, max ${ms(device.inference_max_ms)}`);
+    if (device.cpu_load)
+        $$("device_cpu_load").setValue(device.cpu_load.map(l => l === null ? "-" : l + "%").join(" / "));
+    if (device.heap_min !== undefined)
+        $$("device_heap_min").setValue(`${formatBytes(device.heap_min)}, largest block ${formatBytes(device.heap_largest_block)}`);
+    if (device.dropped_samples !== undefined)
+        $$("device_drops").setValue(`${device.dropped_samples} dropped, ${device.overrun_samples} overrun`);
+    if (device.agc_gain_db !== undefined)
+        $$("device_agc").setValue(`${device.agc_gain_db} dB, level ${device.agc_level}, ${device.agc_gated_blocks}/${device.agc_blocks} gated, ${device.agc_clipped_samples} clipped`);
+    if (device.rssi !== undefined)
+        $$("device_rssi").setValue(device.rssi + " dBm");
+    if (device.ble_notify_ms)
+        $$("device_ble").setValue(device.ble_connected
+            ? `${device.ble_interval_ms} ms interval, notify ${ms(device.ble_notify_ms[0])}, sent ${ms(device.ble_complete_ms[0])}`
+            : "not connected");
+    if (device.battery_mv !== undefined)
+        $$("device_battery").setValue(`${(device.battery_mv / 1000).toFixed(2)} V, ${device.battery_percent}%`);
+    if (device.label_turns)
+        $$("device_turns").setValue(device.label_turns.map((n, i) => n > 0 ? `${i}:${n}` : null).filter(x => x).join(", "));
 }
 
 function getCurrentSettings() {
@@ -500,6 +531,25 @@ function updateDeviceLanguage(language) {
     }
 }
 
+// audio codec the device uses for uploads and streaming
+function updateDeviceCodec(codec) {
+    const deviceId = $$("device_chip_id").getValue();
+    if (deviceId) {
+        webix.ajax().headers({
+            "Content-Type": "application/json"
+        }).post("/api/session/codec", JSON.stringify({
+            chip_id: deviceId,
+            codec: codec
+        }), {
+            success: function(response) {
+                showStatus("Audio codec set to " + codec);
+            },
+            error: function(err) {
+                showStatus("Failed to update codec: " + (err.response?.json?.message || err.status), true);
+            }
+        });
+    }
+}
 
 function updateDeviceLabel(label) {
     const deviceId = $$("device_chip_id").getValue();
@@ -599,6 +649,9 @@ function connectWebSocket(deviceId) {
         try {
             const data = JSON.parse(event.data);
             console.log('Parsed WebSocket data:', data);
+            if (data.type === 'device_delta') {
+                updateDeviceInfo(Object.assign(currentDevice, data.data));
+            }
             if (data.type === 'device_update') {
                 updateDeviceInfo(data.data);
                 
@@ -712,6 +765,10 @@ webix.ready(function() {
     });
 
 
+    $$("device_codec").attachEvent("onChange", function(newv) {
+        updateDeviceCodec(newv);
+    });
+
     // Initialize language filter and all comboboxes
     initLanguageFilter();
     initAudioPlayer();
@@ -5,7 +5,11 @@ from threading import Thread
 from pydub import AudioSegment
 from datetime import datetime
 from DeviceSessionManager import DeviceSessionManager
+from StreamServer import StreamServer, FRAME_HEARTBEAT
+from OtaManager import OtaManager
+import adpcm, heartbeat
 from flask_sock import Sock
+from werkzeug.serving import WSGIRequestHandler
 
 # Flask server and the websocket connection
 app = Flask(__name__, static_folder='static')
@@ -16,9 +20,14 @@ BASE_DIR = os.path.dirname(os.path.abspath(__file__))
 DATASET_DIR = os.path.join(BASE_DIR, '../dataset')
 TRAINING_DIR = os.path.join(BASE_DIR, '../trainingdataset')
 RECORDING_DIR = os.path.join(BASE_DIR, '../recording')
+FLIGHT_DIR = os.path.join(RECORDING_DIR, 'flight')     # snapshots of the flight recorder around page turns
+OTA_DIR = os.path.join(BASE_DIR, '../ota')
 
 BYTES_PER_SAMPLE = 2
 SAMPLE_RATE = 16000
+STREAM_PORT = 8001      # framed binary audio stream of the devices
+ADPCM_CONTENT_TYPE = 'audio/x-ima-adpcm'
+AUDIO_CODECS = ['pcm16', 'adpcm']
 
 # Check if dataset directory exists
 if not os.path.exists(DATASET_DIR):
@@ -27,6 +36,7 @@ if not os.path.exists(TRAINING_DIR):
     os.makedirs(TRAINING_DIR, exist_ok=True)
 if not os.path.exists(RECORDING_DIR):
     os.makedirs(RECORDING_DIR, exist_ok=True)
+os.makedirs(FLIGHT_DIR, exist_ok=True)
     
 
 # Global dictionary to store all devices by chip_id
@@ -34,6 +44,7 @@ device_registry = {}
 # all web socket connections
 client_connections = set()  # Track all connected clients
 session_manager = DeviceSessionManager(device_registry, client_connections)
+ota_manager = OtaManager(OTA_DIR)
 
 
 # Language mappings
@@ -567,6 +578,31 @@ def handle_device_info():
             'message': f'Error processing device info: {str(e)}'
         }), 500
 
+# heartbeat frame of a device on the stream connection, the dashboard gets the fields that changed
+def handle_heartbeat(device, seq, flags, confidences, payload):
+    data = heartbeat.decode(payload)
+    if data is None:
+        print(f"heartbeat of {device}: unknown version or size {len(payload)}")
+        return
+
+    chip_id = device                        # lowercase hex, the same id as /api/audio and /api/session
+    session_manager.get_or_create_session(chip_id)
+    data['chipid'] = chip_id
+    data['last_seen'] = datetime.now().isoformat()
+
+    is_new = chip_id not in device_registry
+    changed = heartbeat.delta(device_registry.get(chip_id, {}), data)
+    device_registry.setdefault(chip_id, {}).update(data)
+
+    session_manager.broadcast_device_update(chip_id, {
+        'type': 'device_delta',
+        'data': changed
+    })
+    if is_new:
+        print(f"New device registered: {chip_id}")
+    if is_new or 'owner' in changed:
+        broadcast_device_list()
+
 @app.route('/api/devices')
 def get_devices():
     try:
@@ -625,88 +661,122 @@ def get_device_details(device_id):
             'heap': device.get('freeheap', 'Unknown'),
             'version': device.get('version', 'Unknown'),
             'last_seen': device.get('last_seen'),
+            'codec': session.get('codec', 'pcm16'),
             'recording_history': recording_history
         })
     except Exception as e:
         print(f"{str(e)}")
         return jsonify({'error': str(e)}), 500
 
+def new_recording_path(device_id):
+    """Returns (filepath, relative_path) of the next recording of a device, depending on the label of its session"""
+    # Check if we have device session with label
+    device_session = session_manager.get_or_create_session(device_id)
+
+    # Use the label from the session if available and not "No label"
+    label = device_session.get('label')
+    if not label or label == "No label":
+        label = "No label"
+        subfolder = None
+        storage_dir = RECORDING_DIR
+        filename_prefix = "sample"
+    else:
+        # Map UI label to folder name
+        subfolder = next((f for n, f in zip(FOLDER_MAPPING['name'], FOLDER_MAPPING['label']) 
+                      if n == label), None)
+        
+        if subfolder:
+            storage_dir = os.path.join(DATASET_DIR, subfolder)
+            filename_prefix = label.lower()
+            os.makedirs(storage_dir, exist_ok=True)
+        else:
+            storage_dir = RECORDING_DIR
+            filename_prefix = "sample"
+    
+    # Generate unique filename
+    counter = 1
+    while True:
+        filename = f"{filename_prefix}_{counter:04d}.wav"
+        filepath = os.path.join(storage_dir, filename)
+        if not os.path.exists(filepath):
+            break
+        counter += 1
+    app.logger.info(f"storing in  {filepath}");
+
+    # Update recording history with correct relative path
+    if subfolder:
+        relative_path = f"{subfolder}/{filename}"
+    else:
+        relative_path = f"../recording/{filename}"
+
+    return filepath, relative_path
+
+
+def recording_finished(device_id, relative_path):
+    """Update the recording history of the device and push it to the dashboard"""
+    timestamp = datetime.now().isoformat()
+    session_manager.update_recording_history(device_id, relative_path)
+    
+    # Get current device data
+    device_data = device_registry.get(device_id, {})
+    
+    # Prepare update with proper structure
+    update_data = {
+        'type': 'device_update',
+        'data': {
+            **device_data,
+            'recording_history': {
+                'last_filename': relative_path,
+                'last_timestamp': timestamp
+            },
+            'last_seen': timestamp
+        }
+    }
+    
+    print(f"Broadcasting update for device {device_id}: {update_data}")  # More detailed logging
+    session_manager.broadcast_device_update(device_id, update_data)
+
+
+# last flight recorder snapshot per device, its probabilities follow in a second request
+last_flight_snapshot = {}
+
+def new_flight_path(device_id, trigger):
+    """Returns (filepath, relative_path) of a flight recorder snapshot"""
+    trigger = ''.join(c for c in trigger if c.isalnum() or c == '_')
+    filename = f"{device_id}_{datetime.now().strftime('%Y%m%d_%H%M%S_%f')}_{trigger}.wav"
+    filepath = os.path.join(FLIGHT_DIR, filename)
+    last_flight_snapshot[device_id] = filepath
+    return filepath, f"../recording/flight/{filename}"
+
 @app.route('/api/audio/<device_id>', methods=['POST'])
 def receive_audio(device_id):
     try:
         if not device_id or  device_id == "none":
             return jsonify({'error': 'Device not passed found'}), 404
 
-        # Check if we have device session with label
-        device_session = session_manager.get_or_create_session(device_id)
-
-        # Use the label from the session if available and not "No label"
-        label = device_session.get('label')
-        if not label or label == "No label":
-            label = "No label"
-            subfolder = None
-            storage_dir = RECORDING_DIR
-            filename_prefix = "sample"
+        # flight recorder snapshots carry their trigger, they do not go into the dataset
+        trigger = request.args.get('trigger')
+        if trigger:
+            filepath, relative_path = new_flight_path(device_id, trigger)
         else:
-            # Map UI label to folder name
-            subfolder = next((f for n, f in zip(FOLDER_MAPPING['name'], FOLDER_MAPPING['label']) 
-                          if n == label), None)
-            
-            if subfolder:
-                storage_dir = os.path.join(DATASET_DIR, subfolder)
-                filename_prefix = label.lower()
-                os.makedirs(storage_dir, exist_ok=True)
-            else:
-                storage_dir = RECORDING_DIR
-                filename_prefix = "sample"
-        
-        # Generate unique filename
-        counter = 1
-        while True:
-            filename = f"{filename_prefix}_{counter:04d}.wav"
-            filepath = os.path.join(storage_dir, filename)
-            if not os.path.exists(filepath):
-                break
-            counter += 1
-        app.logger.info(f"storing in  {filepath}");
-
+            filepath, relative_path = new_recording_path(device_id)
         
-        # Write as a WAV file (16-bit mono, 16kHz)
+        # Write as a WAV file (16-bit mono, 16kHz), long recordings arrive chunked and are written as they come
         with wave.open(filepath, 'wb') as wav_file:
             wav_file.setnchannels(1)
             wav_file.setsampwidth(BYTES_PER_SAMPLE)
             wav_file.setframerate(SAMPLE_RATE)
-            wav_file.writeframes(request.data)
-        
-        # Update recording history with correct relative path
-        if subfolder:
-            relative_path = f"{subfolder}/{filename}"
-        else:
-            relative_path = f"../recording/{filename}"
-
-
-        # Update recording history if device is specified
-        timestamp = datetime.now().isoformat()
-        session_manager.update_recording_history(device_id, relative_path)
-        
-        # Get current device data
-        device_data = device_registry.get(device_id, {})
-        
-        # Prepare update with proper structure
-        update_data = {
-            'type': 'device_update',
-            'data': {
-                **device_data,
-                'recording_history': {
-                    'last_filename': relative_path,
-                    'last_timestamp': timestamp
-                },
-                'last_seen': timestamp
-            }
-        }
+            if request.content_type == ADPCM_CONTENT_TYPE:
+                for pcm in adpcm.decode_stream(request.stream.read):
+                    wav_file.writeframes(pcm)
+            else:
+                while True:
+                    block = request.stream.read(65536)
+                    if not block:
+                        break
+                    wav_file.writeframes(block)
         
-        print(f"Broadcasting update for device {device_id}: {update_data}")  # More detailed logging
-        session_manager.broadcast_device_update(device_id, update_data)
+        recording_finished(device_id, relative_path)
             
         return jsonify({
             'success': True
@@ -718,6 +788,21 @@ def receive_audio(device_id):
             'message': f"Error processing audio: {str(e)}"
         }), 500
 
+# probability vectors of the last flight recorder snapshot as CSV, stored next to its audio
+@app.route('/api/audio/<device_id>/probabilities', methods=['POST'])
+def receive_flight_probabilities(device_id):
+    filepath = last_flight_snapshot.get(device_id)
+    if not filepath:
+        return jsonify({'error': 'no snapshot of this device'}), 404
+    with open(os.path.splitext(filepath)[0] + '.csv', 'wb') as f:
+        while True:
+            block = request.stream.read(65536)
+            if not block:
+                break
+            f.write(block)
+    print(f"flight snapshot of device {device_id}: {os.path.basename(filepath)}")
+    return jsonify({'success': True})
+
 @app.route('/api/session/language', methods=['POST'])
 def update_session_language():
     try:
@@ -756,6 +841,47 @@ def update_session_label():
         return jsonify({'error': str(e)}), 500
 
 
+@app.route('/api/session/codec', methods=['POST'])
+def update_session_codec():
+    try:
+        data = request.json
+        chip_id = data.get('chip_id')
+        codec = data.get('codec')
+
+        if not chip_id or codec not in AUDIO_CODECS:
+            return jsonify({'error': 'Missing chip_id or unknown codec'}), 400
+
+        session_manager.update_codec(chip_id, codec)
+        return jsonify({'success': True})
+
+    except Exception as e:
+        return jsonify({'error': str(e)}), 500
+
+# polled by the device before every upload or stream, answers the plain codec name
+@app.route('/api/session/codec/<device_id>')
+def get_session_codec(device_id):
+    return session_manager.get_codec(device_id), 200, {'Content-Type': 'text/plain'}
+
+# OTA update of firmware ('app') or model, the device passes the SHA-256 of what it runs.
+# Answers 204 if it is up to date, otherwise a delta patch (see otadelta.py)
+@app.route('/api/ota/<target>/<device_id>')
+def get_ota_patch(target, device_id):
+    try:
+        patch = ota_manager.get_patch(target, request.args.get('sha', ''))
+        if patch is None:
+            return '', 204
+        print(f"OTA {target} for device {device_id}: {len(patch)} bytes")
+        return patch, 200, {'Content-Type': 'application/octet-stream'}
+    except ValueError as e:
+        return jsonify({'error': str(e)}), 400
+
+# result of an update as measured by the device: "<target> <result> <bytes> <ms>"
+@app.route('/api/ota/report/<device_id>', methods=['POST'])
+def ota_report(device_id):
+    print(f"OTA report of device {device_id}: {request.get_data(as_text=True)}")
+    return jsonify({'success': True})
+
+
 
 
 def cleanup_sessions():
@@ -771,9 +897,16 @@ if __name__ == '__main__':
             # Only runs in the reloader process, not the initial boot
             Thread(target=populate_folder_mapping_stats, daemon=True).start()
 
+            # persistent binary audio streams of the devices
+            stream_server = StreamServer(STREAM_PORT, new_recording_path, recording_finished)
+            stream_server.frame_handlers[FRAME_HEARTBEAT] = handle_heartbeat
+            stream_server.start()
+
         # cleanup unused session
         Thread(target=cleanup_sessions, daemon=True).start()
 
+        # HTTP/1.1 keeps the connection of a device open between its requests
+        WSGIRequestHandler.protocol_version = "HTTP/1.1"
         app.run(host="0.0.0.0", port=8000, debug=True)
     except Exception as e:
         print(f"Failed to start server: {str(e)}")
\ No newline at end of file